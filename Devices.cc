@@ -0,0 +1,53 @@
+/*
+   copyright 2026 Paul Dreik
+   Distributed under GPL v 2.0 or later, at your option.
+   See LICENSE for further details.
+*/
+
+#include "config.h"
+
+// std
+#include <cerrno>
+#include <fstream>
+
+// os
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef HAVE_SYS_SYSMACROS_H
+#include <sys/sysmacros.h>
+#endif
+
+// project
+#include "Devices.hh"
+
+unsigned long
+Devices::deviceof(const std::string& path)
+{
+  struct stat info;
+  int statval = 0;
+  do {
+    statval = stat(path.c_str(), &info);
+  } while (statval < 0 && errno == EINTR);
+  return statval == 0 ? info.st_dev : 0;
+}
+
+bool
+Devices::isrotational(unsigned long device)
+{
+#ifdef HAVE_SYS_SYSMACROS_H
+  const dev_t dev = device;
+  const std::string base = "/sys/dev/block/" + std::to_string(major(dev)) +
+                           ":" + std::to_string(minor(dev));
+  // a partition has the queue settings on the disk it is part of
+  for (const char* queue : { "/queue/rotational", "/../queue/rotational" }) {
+    std::ifstream f(base + queue);
+    int rotational = 0;
+    if (f >> rotational) {
+      return rotational != 0;
+    }
+  }
+#else
+  (void)device;
+#endif
+  return false;
+}
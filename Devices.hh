@@ -0,0 +1,29 @@
+/*
+   copyright 2026 Paul Dreik
+   Distributed under GPL v 2.0 or later, at your option.
+   See LICENSE for further details.
+*/
+#ifndef RDFIND_DEVICES_HH_
+#define RDFIND_DEVICES_HH_
+
+#include <string>
+
+/**
+ * Helpers to schedule work per device, so that independent disks are kept
+ * busy at the same time.
+ */
+namespace Devices {
+/**
+ * gets the device path is on, following symlinks.
+ * @return the device, or 0 if it could not be found out.
+ */
+unsigned long deviceof(const std::string& path);
+
+/**
+ * true if device is known to be a rotating disk, where concurrent reads
+ * cause seeking. only known on linux, through sysfs.
+ */
+bool isrotational(unsigned long device);
+} // namespace Devices
+
+#endif /* RDFIND_DEVICES_HH_ */
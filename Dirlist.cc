@@ -7,13 +7,23 @@
 #include "config.h"
 
 // std
+#include <atomic>
 #include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
+#include <deque>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 // os
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -22,25 +32,618 @@
 #include "Dirlist.hh"
 #include "RdfindDebug.hh" //debug macros
 
-static const int maxdepth = 50;
+#if defined(HAVE_OPENAT) && defined(HAVE_FDOPENDIR) &&                       \
+  defined(HAVE_FSTATAT) && defined(HAVE_DIRFD)
+// open subdirectories and stat items relative to the directory file
+// descriptor, instead of having the kernel resolve the full path each time.
+#define DIRLIST_USE_AT_FUNCTIONS 1
+#endif
+
+#if defined(DIRLIST_USE_AT_FUNCTIONS) && HAVE_DECL_SYS_GETDENTS64
+// read directories with the getdents64 system call, bypassing the small
+// buffer readdir uses.
+#define DIRLIST_USE_GETDENTS 1
+#include <sys/syscall.h>
+#endif
+
+#if defined(DIRLIST_USE_AT_FUNCTIONS) && defined(HAVE_STRUCT_DIRENT_D_TYPE)
+// the entries of a directory can be statted in batches through io_uring
+// relative to the directory file descriptor, if StatxRing supports it.
+#define DIRLIST_USE_URING 1
+#endif
+
+// how many entries are statted at once with statenginetype::URING
+static const unsigned ringentries = 256;
+
+namespace {
+// the kinds of directory entries walk cares about
+enum class Itemtype
+{
+  REGULAR,
+  DIRECTORY,
+  SYMLINK,
+  OTHER,
+  FAILED
+};
+
+Itemtype
+classify(mode_t mode)
+{
+  if (S_ISLNK(mode)) {
+    return Itemtype::SYMLINK;
+  }
+  if (S_ISDIR(mode)) {
+    return Itemtype::DIRECTORY;
+  }
+  if (S_ISREG(mode)) {
+    return Itemtype::REGULAR;
+  }
+  return Itemtype::OTHER;
+}
+
+// stats path, following symlinks if follow is true.
+bool
+statpath(const std::string& path, bool follow, struct stat& info)
+{
+  int statval = 0;
+  do {
+    statval = follow ? stat(path.c_str(), &info) : lstat(path.c_str(), &info);
+  } while (statval < 0 && errno == EINTR);
+  return statval == 0;
+}
+
+// stats the item name in the open directory dirfd, which has the path dir.
+// follows symlinks if follow is true.
+bool
+statentry(int dirfd,
+          const std::string& dir,
+          const char* name,
+          bool follow,
+          struct stat& info)
+{
+#ifdef DIRLIST_USE_AT_FUNCTIONS
+  // dirfd is not open if the entries come from a snapshot
+  if (dirfd >= 0) {
+    const int flags = follow ? 0 : AT_SYMLINK_NOFOLLOW;
+    int statval = 0;
+    do {
+      statval = fstatat(dirfd, name, &info, flags);
+    } while (statval < 0 && errno == EINTR);
+    return statval == 0;
+  }
+#else
+  (void)dirfd;
+#endif
+  return statpath(dir + "/" + name, follow, info);
+}
+
+// finds out what kind of item name (found in dirfd, with path dir) is,
+// without following symlinks. the type from reading the directory is used
+// when the file system provides it, which saves one lstat per entry. if
+// lstat had to be called, info is filled in and statted is set.
+Itemtype
+classify(int dirfd,
+         const std::string& dir,
+         const char* name,
+         unsigned char type,
+         struct stat& info,
+         bool& statted)
+{
+  statted = false;
+#ifdef HAVE_STRUCT_DIRENT_D_TYPE
+  switch (type) {
+    case DT_REG:
+      return Itemtype::REGULAR;
+    case DT_DIR:
+      return Itemtype::DIRECTORY;
+    case DT_LNK:
+      return Itemtype::SYMLINK;
+    case DT_UNKNOWN:
+      // not all file systems fill in d_type, fall back to lstat.
+      break;
+    default:
+      return Itemtype::OTHER;
+  }
+#else
+  (void)type;
+#endif
+  if (!statentry(dirfd, dir, name, false, info)) {
+    // failed to do stat
+    return Itemtype::FAILED;
+  }
+  statted = true;
+  return classify(info.st_mode);
+}
+
+/**
+ * the entries of an open directory, read either through readdir or by
+ * calling getdents64 directly into a large buffer. in the latter case the
+ * names point into the buffer, no copies are made.
+ */
+class Dirstream
+{
+public:
+  Dirstream() = default;
+  Dirstream(const Dirstream&) = delete;
+  Dirstream& operator=(const Dirstream&) = delete;
+  ~Dirstream() { close(); }
+
+  /**
+   * opens the directory path.
+   * @param fd an already opened descriptor for the directory, or -1.
+   * ownership is taken.
+   * @param buffer if not null, getdents64 is used and reads into buffer.
+   * @return false if the directory could not be opened.
+   */
+  bool open(const std::string& path, int fd, std::vector<char>* buffer)
+  {
+#ifdef DIRLIST_USE_GETDENTS
+    if (buffer != nullptr) {
+      m_buffer = buffer;
+      while (fd < 0) {
+        fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0 && errno != EINTR) {
+          return false;
+        }
+      }
+      m_fd = fd;
+      return true;
+    }
+#else
+    (void)buffer;
+#endif
+#ifdef DIRLIST_USE_AT_FUNCTIONS
+    if (fd >= 0) {
+      m_dirp = fdopendir(fd);
+      if (m_dirp != nullptr) {
+        return true;
+      }
+    }
+#endif
+    if (fd >= 0) {
+      (void)::close(fd);
+    }
+    m_dirp = opendir(path.c_str());
+    return m_dirp != nullptr;
+  }
+
+  /**
+   * gets the next entry. type is one of the DT_ constants, or zero if
+   * not known.
+   * @return false when there are no more entries.
+   */
+  bool next(const char*& name, unsigned char& type)
+  {
+#ifdef DIRLIST_USE_GETDENTS
+    if (m_buffer != nullptr) {
+      // the layout of the records returned by the kernel
+      struct linux_dirent64
+      {
+        std::uint64_t d_ino;
+        std::int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[1];
+      };
+      while (m_pos >= m_end) {
+        const long nread =
+          syscall(SYS_getdents64, m_fd, m_buffer->data(), m_buffer->size());
+        if (nread < 0 && errno == EINTR) {
+          continue;
+        }
+        if (nread <= 0) {
+          return false;
+        }
+        m_pos = 0;
+        m_end = static_cast<std::size_t>(nread);
+      }
+      const char* record = m_buffer->data() + m_pos;
+      unsigned short reclen = 0;
+      std::memcpy(&reclen,
+                  record + offsetof(linux_dirent64, d_reclen),
+                  sizeof(reclen));
+      type = static_cast<unsigned char>(
+        record[offsetof(linux_dirent64, d_type)]);
+      name = record + offsetof(linux_dirent64, d_name);
+      m_pos += reclen;
+      return true;
+    }
+#endif
+    const struct dirent* dp = readdir(m_dirp);
+    if (dp == nullptr) {
+      return false;
+    }
+    name = dp->d_name;
+#ifdef HAVE_STRUCT_DIRENT_D_TYPE
+    type = dp->d_type;
+#else
+    type = 0;
+#endif
+    return true;
+  }
+
+  // the descriptor to stat and open entries relative to, -1 if the *at
+  // functions are not available.
+  int fd() const
+  {
+#ifdef DIRLIST_USE_AT_FUNCTIONS
+    return m_dirp != nullptr ? dirfd(m_dirp) : m_fd;
+#else
+    return -1;
+#endif
+  }
+
+  void close()
+  {
+    if (m_dirp != nullptr) {
+      (void)closedir(m_dirp);
+      m_dirp = nullptr;
+    }
+    if (m_fd >= 0) {
+      (void)::close(m_fd);
+      m_fd = -1;
+    }
+  }
+
+private:
+  DIR* m_dirp{};
+  int m_fd = -1;
+  std::vector<char>* m_buffer{};
+  std::size_t m_pos = 0;
+  std::size_t m_end = 0;
+};
+
+#ifdef DIRLIST_USE_URING
+// which stat, if any, an entry of a given type needs
+enum class Neededstat
+{
+  NONE,
+  NOFOLLOW,
+  FOLLOW
+};
+
+Neededstat
+neededstat(unsigned char type, bool followsymlinks)
+{
+  switch (type) {
+    case DT_REG:
+    case DT_UNKNOWN:
+      return Neededstat::NOFOLLOW;
+    case DT_LNK:
+      return followsymlinks ? Neededstat::FOLLOW : Neededstat::NONE;
+    default:
+      return Neededstat::NONE;
+  }
+}
+
+// a directory entry waiting for its stat. name is the offset of the name in
+// the buffer holding the names of the batch.
+struct Batchentry
+{
+  std::size_t name;
+  unsigned char type;
+  Neededstat stat;
+  StatxRing::Result result;
+};
+#endif
+
+// a directory waiting to be read by walk. fd is the already opened
+// directory, or -1 if it has to be opened through path.
+struct Dirtask
+{
+  std::string path;
+  int fd;
+  int recursionlevel;
+};
+
+// a queue of directories, one per worker thread. the owner pushes at the
+// back and pops at the back for depth first or at the front for breadth
+// first order. other workers steal from the front where the oldest and
+// typically largest subtrees are.
+class Workqueue
+{
+public:
+  void push(Dirtask task)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tasks.push_back(std::move(task));
+  }
+  bool pop(Dirtask& task, bool breadthfirst)
+  {
+    if (breadthfirst) {
+      return steal(task);
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_tasks.empty()) {
+      return false;
+    }
+    task = std::move(m_tasks.back());
+    m_tasks.pop_back();
+    return true;
+  }
+  bool steal(Dirtask& task)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_tasks.empty()) {
+      return false;
+    }
+    task = std::move(m_tasks.front());
+    m_tasks.pop_front();
+    return true;
+  }
+
+private:
+  std::mutex m_mutex;
+  std::deque<Dirtask> m_tasks;
+};
+
+// hands the entries of a directory from a snapshot to handle, as they would
+// have been found when reading it. only the names are known, handle stats
+// the files again.
+template<class Handle>
+void
+replay(const std::string& entries, Handle& handle)
+{
+  Snapshot::Entry e;
+  std::size_t pos = 0;
+  struct stat info;
+  while (Snapshot::next(entries, pos, e)) {
+    switch (e.kind) {
+      case Snapshot::REGULAR:
+        handle(e.name, Itemtype::REGULAR, info, false);
+        break;
+      case Snapshot::SUBDIR:
+        handle(e.name, Itemtype::DIRECTORY, info, false);
+        break;
+      case Snapshot::SYMLINK:
+        handle(e.name, Itemtype::SYMLINK, info, false);
+        break;
+      default:
+        break;
+    }
+  }
+}
+} // namespace
+
+bool
+Dirlist::hasgetdents()
+{
+#ifdef DIRLIST_USE_GETDENTS
+  return true;
+#else
+  return false;
+#endif
+}
+
+long
+Dirlist::defaultfdbudget()
+{
+  // leave plenty of room for the rest of the program, including the
+  // directories held open by each thread while it reads them.
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0 ||
+      limit.rlim_cur == RLIM_INFINITY) {
+    return 256;
+  }
+  return static_cast<long>(limit.rlim_cur / 2);
+}
+
+std::vector<char>
+Dirlist::getbuffer()
+{
+  std::lock_guard<std::mutex> lock(m_buffersmutex);
+  if (m_buffers.empty()) {
+    return std::vector<char>(m_buffersize);
+  }
+  std::vector<char> buffer = std::move(m_buffers.back());
+  m_buffers.pop_back();
+  return buffer;
+}
+
+void
+Dirlist::putbuffer(std::vector<char> buffer)
+{
+  std::lock_guard<std::mutex> lock(m_buffersmutex);
+  m_buffers.push_back(std::move(buffer));
+}
+
+bool
+Dirlist::hasuring()
+{
+#ifdef DIRLIST_USE_URING
+  StatxRing ring(1);
+  return ring.ok();
+#else
+  return false;
+#endif
+}
+
+std::unique_ptr<StatxRing>
+Dirlist::getring()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_ringsmutex);
+    if (!m_rings.empty()) {
+      std::unique_ptr<StatxRing> ring = std::move(m_rings.back());
+      m_rings.pop_back();
+      return ring;
+    }
+  }
+  std::unique_ptr<StatxRing> ring(new StatxRing(ringentries));
+  if (!ring->ok() || ring->capacity() < ringentries) {
+    return nullptr;
+  }
+  return ring;
+}
+
+void
+Dirlist::putring(std::unique_ptr<StatxRing> ring)
+{
+  std::lock_guard<std::mutex> lock(m_ringsmutex);
+  m_rings.push_back(std::move(ring));
+}
 
 int
-Dirlist::walk(const std::string& dir, const int recursionlevel)
+Dirlist::opensubdir(int dirfd, const char* name)
+{
+#ifdef DIRLIST_USE_AT_FUNCTIONS
+  if (dirfd < 0) {
+    return -1;
+  }
+  if (--m_fdsleft < 0) {
+    // over budget, the directory will be opened by path when it is read.
+    ++m_fdsleft;
+    return -1;
+  }
+  int fd = -1;
+  do {
+    fd = openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0) {
+    ++m_fdsleft;
+  }
+  return fd;
+#else
+  (void)dirfd;
+  (void)name;
+  return -1;
+#endif
+}
+
+template<class Onsubdir>
+int
+Dirlist::readdirectory(const std::string& dir,
+                       const int fd,
+                       const int recursionlevel,
+                       Onsubdir onsubdir)
 {
 
   RDDEBUG("Now in walk with dir=" << dir.c_str() << " and recursionlevel="
                                   << recursionlevel << std::endl);
 
-  if (recursionlevel >= maxdepth) {
+  // a descriptor from opensubdir counts against the budget until closed.
+  const bool ownsbudget = fd >= 0;
+
+  if (m_maxdepth >= 0 && recursionlevel > m_maxdepth) {
     std::cerr << "recursion limit exceeded\n";
+    if (ownsbudget) {
+      (void)close(fd);
+      ++m_fdsleft;
+    }
     return -1;
   }
 
+  // the directory file descriptor, once opened
+  int dirfd = fd;
+
+  // the entries read, for the snapshot
+  std::string entries;
+  bool recording = false;
+
+  // queues the subdirectory name to be read, unless it is excluded or too
+  // deep. this is checked before opening it, so nothing below is read.
+  auto descend = [&](const char* name) {
+    if (m_excludedirs.matches(dir, name)) {
+      return;
+    }
+    if (m_maxdepth >= 0 && recursionlevel + 1 > m_maxdepth) {
+      m_toodeep = true;
+      return;
+    }
+    onsubdir(dir + "/" + name, opensubdir(dirfd, name), recursionlevel + 1);
+  };
+
+  // takes care of one entry. kind is what the entry is without following
+  // symlinks. if statted is set, info holds the result of stat on the entry,
+  // for symlinks with the link followed.
+  auto handle =
+    [&](const char* name, Itemtype kind, struct stat& info, bool statted) {
+      switch (kind) {
+        case Itemtype::SYMLINK:
+          if (recording) {
+            Snapshot::addsymlink(entries, name);
+          }
+          // the target decides if it is a file or a directory.
+          if (m_followsymlinks) {
+            if (!statted && !statentry(dirfd, dir, name, true, info)) {
+              std::cerr << "failed to read file info on file \"" << dir
+                        << '/' << name << "\": " << strerror(errno) << '\n';
+            } else if (S_ISDIR(info.st_mode)) {
+              descend(name);
+            } else if (S_ISREG(info.st_mode) &&
+                       !m_excludefiles.matches(dir, name)) {
+              (*m_callback)(dir, name, recursionlevel, info, m_tag);
+            }
+          }
+          break;
+        case Itemtype::DIRECTORY:
+          if (recording) {
+            Snapshot::adddirectory(entries, name);
+          }
+          descend(name);
+          break;
+        case Itemtype::REGULAR:
+          // the item is needed in full, make sure it is statted exactly once.
+          // an entry from a snapshot is statted here, and is checked since
+          // the kind was not just read.
+          if (!m_excludefiles.matches(dir, name)) {
+            statted = statted || statentry(dirfd, dir, name, false, info);
+            if (statted && S_ISREG(info.st_mode)) {
+              (*m_callback)(dir, name, recursionlevel, info, m_tag);
+            }
+          }
+          if (recording) {
+            Snapshot::addfile(entries, name);
+          }
+          break;
+        case Itemtype::FAILED:
+          // the entry may be there next time, the listing is incomplete
+          recording = false;
+          break;
+        case Itemtype::OTHER:
+          break;
+      }
+    };
+
+  // with a snapshot, a directory unchanged since it was taken is not read.
+  // the entries found then are handled as if they were just read, which
+  // stats the files through the still open fd, so their sizes are current.
+  struct stat dirinfo;
+  if (m_snapshot) {
+    int statval = 0;
+    do {
+      statval = fd >= 0 ? fstat(fd, &dirinfo) : stat(dir.c_str(), &dirinfo);
+    } while (statval < 0 && errno == EINTR);
+    recording = statval == 0 && S_ISDIR(dirinfo.st_mode);
+    const std::string* cached =
+      recording ? m_snapshot->find(dirinfo) : nullptr;
+    if (cached) {
+      recording = false;
+      replay(*cached, handle);
+      if (ownsbudget) {
+        (void)close(fd);
+        ++m_fdsleft;
+      }
+      return 2;
+    }
+  }
+
   // open the directory
-  DIR* dirp = opendir(dir.c_str());
-  if (dirp == nullptr) {
+  const bool usegetdents = m_reader == readertype::GETDENTS;
+  std::vector<char> buffer;
+  if (usegetdents) {
+    buffer = getbuffer();
+  }
+  Dirstream stream;
+  if (!stream.open(dir, fd, usegetdents ? &buffer : nullptr)) {
     // failed to open directory
     RDDEBUG("failed to open directory" << std::endl);
+    if (ownsbudget) {
+      ++m_fdsleft;
+    }
+    if (usegetdents) {
+      putbuffer(std::move(buffer));
+    }
     // this can be due to rights, or some other error.
     handlepossiblefile(dir, recursionlevel);
     return 1; // it's a file (or something else)
@@ -48,51 +651,213 @@ Dirlist::walk(const std::string& dir, const int recursionlevel)
 
   // we opened the directory. let us read the content.
   RDDEBUG("opened directory" << std::endl);
-  struct dirent* dp{};
-  while (nullptr != (dp = readdir(dirp))) {
-    // is the directory . or ..?
-    if (0 == strcmp(".", dp->d_name) || 0 == strcmp("..", dp->d_name)) {
-      continue;
-    }
-    // investigate what kind of file it is, dont follow any
-    // symlinks when doing this (lstat instead of stat).
-    struct stat info;
-    const int statval =
-      lstat((dir + "/" + std::string(dp->d_name)).c_str(), &info);
-    if (statval != 0) {
-      // failed to do stat
-      continue;
-    }
-
-    // investigate what kind of item it was.
-    bool dowalk = false;
-
-    if (S_ISLNK(info.st_mode)) {
-      // symlink
-      if (m_followsymlinks) {
-        (*m_callback)(dir, std::string(dp->d_name), recursionlevel);
-        dowalk = true;
+  dirfd = stream.fd();
+
+  const char* name{};
+  unsigned char type{};
+#ifdef DIRLIST_USE_URING
+  if (m_statengine == statenginetype::URING && dirfd >= 0) {
+    // the entries are read in batches. the stats needed for a batch are
+    // submitted at once, then the entries are handled in directory order.
+    // anything the ring failed on is retried the ordinary way.
+    std::vector<Batchentry> batch;
+    std::string names;
+    bool more = true;
+    while (more) {
+      batch.clear();
+      names.clear();
+      more = false;
+      while (stream.next(name, type)) {
+        if (0 == strcmp(".", name) || 0 == strcmp("..", name)) {
+          continue;
+        }
+        // excluded items of a known type need no stat
+        if (type == DT_REG && m_excludefiles.matches(dir, name)) {
+          if (recording) {
+            Snapshot::addfile(entries, name);
+          }
+          continue;
+        }
+        if (type == DT_DIR && m_excludedirs.matches(dir, name)) {
+          if (recording) {
+            Snapshot::adddirectory(entries, name);
+          }
+          continue;
+        }
+        batch.push_back(Batchentry{ names.size(),
+                                    type,
+                                    neededstat(type, m_followsymlinks),
+                                    StatxRing::Result{} });
+        names.append(name, strlen(name) + 1);
+        if (batch.size() == ringentries) {
+          more = true;
+          break;
+        }
       }
-    } else if (S_ISDIR(info.st_mode)) {
-      // directory
-      dowalk = true;
-    } else if (S_ISREG(info.st_mode)) {
-      // regular file
-      (*m_callback)(dir, std::string(dp->d_name), recursionlevel);
-    }
 
-    // try to open directory
-    if (dowalk) {
-      walk(dir + "/" + dp->d_name, recursionlevel + 1);
+      bool ringok = false;
+      std::unique_ptr<StatxRing> ring;
+      if (!batch.empty()) {
+        ring = getring();
+      }
+      if (ring) {
+        for (auto& e : batch) {
+          if (e.stat != Neededstat::NONE) {
+            ring->add(dirfd,
+                      names.data() + e.name,
+                      e.stat == Neededstat::FOLLOW,
+                      &e.result);
+          }
+        }
+        ringok = ring->submitandwait() == 0;
+        // the ring is idle again, let the subdirectories use it. a ring that
+        // failed is not, it is dropped.
+        if (ringok) {
+          putring(std::move(ring));
+        }
+      }
+
+      for (auto& e : batch) {
+        const char* entryname = names.data() + e.name;
+        struct stat& info = e.result.info;
+        bool statted =
+          ringok && e.stat != Neededstat::NONE && e.result.error == 0;
+        Itemtype kind{};
+        if (!statted) {
+          kind = classify(dirfd, dir, entryname, e.type, info, statted);
+          statted = statted && kind != Itemtype::SYMLINK;
+        } else if (e.stat == Neededstat::FOLLOW) {
+          kind = Itemtype::SYMLINK;
+        } else {
+          kind = classify(info.st_mode);
+          statted = kind != Itemtype::SYMLINK;
+        }
+        handle(entryname, kind, info, statted);
+      }
     }
+  } else
+#endif
+  {
+    while (stream.next(name, type)) {
+      // is the directory . or ..?
+      if (0 == strcmp(".", name) || 0 == strcmp("..", name)) {
+        continue;
+      }
 
-  } // while
+      // investigate what kind of item it was. only directories get their
+      // full path built here, files are reported relative to dir.
+      struct stat info;
+      bool statted = false;
+      const Itemtype kind = classify(dirfd, dir, name, type, info, statted);
+      // an lstat of a symlink is not what handle wants
+      handle(name, kind, info, statted && kind != Itemtype::SYMLINK);
+    } // while
+  }
 
   // close the directory
-  (void)closedir(dirp);
+  stream.close();
+  if (ownsbudget) {
+    ++m_fdsleft;
+  }
+  if (usegetdents) {
+    putbuffer(std::move(buffer));
+  }
+  if (recording) {
+    m_snapshot->store(dirinfo, std::move(entries));
+  }
   return 2; // it's a directory
 }
 
+int
+Dirlist::walk(const std::string& dir, const int recursionlevel, const int tag)
+{
+  m_tag = tag;
+  std::vector<Workqueue> queues(m_nthreads);
+  const bool breadthfirst = m_order == ordertype::BREADTHFIRST;
+
+  // number of directories that are queued or being read, and of those
+  // queued
+  std::atomic<std::size_t> pending{ 0 };
+  std::atomic<std::size_t> queued{ 0 };
+
+  // workers without anything to do wait for directories to be queued, or
+  // for all to be done. nidle is the number of them waiting, so the others
+  // only take the mutex when someone needs waking.
+  std::mutex idlemutex;
+  std::condition_variable idle;
+  std::atomic<unsigned> nidle{ 0 };
+  const auto wake = [&](bool all) {
+    if (nidle != 0) {
+      std::lock_guard<std::mutex> lock(idlemutex);
+      if (all) {
+        idle.notify_all();
+      } else {
+        idle.notify_one();
+      }
+    }
+  };
+
+  // the starting point is read by the calling thread, the subdirectories
+  // found are then distributed among the workers.
+  const int ret = readdirectory(
+    dir,
+    -1,
+    recursionlevel,
+    [&](const std::string& subdir, int fd, int level) {
+      ++pending;
+      queues.front().push(Dirtask{ subdir, fd, level });
+      ++queued;
+    });
+
+  auto worker = [&](std::size_t self) {
+    auto onsubdir = [&](const std::string& subdir, int fd, int level) {
+      ++pending;
+      queues[self].push(Dirtask{ subdir, fd, level });
+      ++queued;
+      wake(false);
+    };
+    Dirtask task;
+    for (;;) {
+      bool found = queues[self].pop(task, breadthfirst);
+      for (std::size_t i = 1; !found && i < queues.size(); ++i) {
+        found = queues[(self + i) % queues.size()].steal(task);
+      }
+      if (found) {
+        --queued;
+        readdirectory(task.path, task.fd, task.recursionlevel, onsubdir);
+        if (--pending == 0) {
+          wake(true);
+        }
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(idlemutex);
+      ++nidle;
+      idle.wait(lock, [&] { return queued != 0 || pending == 0; });
+      --nidle;
+      if (pending == 0) {
+        return;
+      }
+    }
+  };
+
+  if (pending != 0) {
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < queues.size(); ++i) {
+      threads.emplace_back(worker, i);
+    }
+    worker(0);
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+  if (m_toodeep.exchange(false)) {
+    std::cerr << "recursion limit exceeded, directories more than "
+              << m_maxdepth << " levels below \"" << dir
+              << "\" were not read\n";
+  }
+  return ret;
+}
+
 // splits inputstring into path and filename. if no / character is found,
 // empty string is returned as path and filename is set to inputstring.
 int
@@ -148,8 +913,11 @@ Dirlist::handlepossiblefile(const std::string& possiblefile, int recursionlevel)
 
   if (S_ISLNK(info.st_mode)) {
     RDDEBUG("found symlink" << std::endl);
-    if (m_followsymlinks) {
-      (*m_callback)(path, filename, recursionlevel);
+    // the target could not be opened as a directory, report it if it is a
+    // regular file.
+    if (m_followsymlinks && statpath(possiblefile, true, info) &&
+        S_ISREG(info.st_mode)) {
+      (*m_callback)(path, filename.c_str(), recursionlevel, info, m_tag);
     }
     return 0;
   } else {
@@ -186,7 +954,7 @@ Dirlist::handlepossiblefile(const std::string& possiblefile, int recursionlevel)
 
   if (S_ISREG(info.st_mode)) {
     RDDEBUG("it is a regular file" << std::endl);
-    (*m_callback)(path, filename, recursionlevel);
+    (*m_callback)(path, filename.c_str(), recursionlevel, info, m_tag);
     return 0;
   } else {
     RDDEBUG("not a regular file" << std::endl);
@@ -7,40 +7,209 @@
 #ifndef Dirlist_hh
 #define Dirlist_hh
 
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
+
+// os specific headers
+#include <sys/stat.h>
+
+// project
+#include "Globmatcher.hh"
+#include "Snapshot.hh"
+#include "StatxRing.hh"
 
 /// class that traverses a directory
 class Dirlist
 {
 public:
+  // how the entries of a directory are read
+  enum class readertype
+  {
+    READDIR,  // through readdir, portable
+    GETDENTS, // through getdents64 into a large buffer, linux only
+  };
+
+  // how the entries of a directory are statted
+  enum class statenginetype
+  {
+    SYNC,  // one stat call at a time, portable
+    URING, // batched through io_uring, linux only
+  };
+
+  // in which order directories waiting to be read are taken
+  enum class ordertype
+  {
+    DEPTHFIRST,   // the most recently found first, keeps the queue short
+    BREADTHFIRST, // level by level
+  };
+
   // constructor
   explicit Dirlist(bool followsymlinks)
     : m_followsymlinks(followsymlinks)
+    , m_nthreads(1)
+    , m_maxdepth(-1)
+    , m_toodeep(false)
+    , m_order(ordertype::DEPTHFIRST)
+    , m_snapshot(nullptr)
+    , m_fdsleft(defaultfdbudget())
+    , m_reader(readertype::READDIR)
+    , m_buffersize(0)
+    , m_statengine(statenginetype::SYNC)
     , m_callback(nullptr)
+    , m_tag(0)
   {}
+  Dirlist(const Dirlist&) = delete;
+  Dirlist& operator=(const Dirlist&) = delete;
+
+  // true if readertype::GETDENTS is supported on this system
+  [[gnu::const]] static bool hasgetdents();
+
+  // true if statenginetype::URING is compiled in and the running kernel
+  // supports it
+  static bool hasuring();
 
 private:
   // follow symlinks or not
   bool m_followsymlinks;
 
+  // how many threads to traverse with. 1 means the calling thread does all
+  // the work.
+  unsigned m_nthreads;
+
+  // directories deeper than this are not read, negative means no limit
+  int m_maxdepth;
+
+  // set when a directory was skipped because of m_maxdepth
+  std::atomic<bool> m_toodeep;
+
+  // the order directories are traversed in
+  ordertype m_order;
+
+  // files and directories matching these are skipped
+  Globmatcher m_excludefiles;
+  Globmatcher m_excludedirs;
+
+  // unchanged directories are taken from here instead of being read, and
+  // the directories read are stored here. nullptr if not used.
+  Snapshot* m_snapshot;
+
+  // how many more directory file descriptors may be held open for
+  // directories waiting to be read. when exhausted, directories are opened
+  // by their path instead.
+  std::atomic<long> m_fdsleft;
+  static long defaultfdbudget();
+
+  // how to read directories, and the buffer size for readertype::GETDENTS
+  readertype m_reader;
+  std::size_t m_buffersize;
+
+  // getdents buffers not in use, kept since they are large
+  std::vector<std::vector<char>> m_buffers;
+  std::mutex m_buffersmutex;
+  std::vector<char> getbuffer();
+  void putbuffer(std::vector<char> buffer);
+
+  // how to stat entries, and the io_uring rings not in use. rings are
+  // expensive to set up so they are reused, one is needed per thread.
+  statenginetype m_statengine;
+  std::vector<std::unique_ptr<StatxRing>> m_rings;
+  std::mutex m_ringsmutex;
+  std::unique_ptr<StatxRing> getring();
+  void putring(std::unique_ptr<StatxRing> ring);
+
   // where to report found files. this is called for every item in all
-  // directories found by walk.
-  typedef int (*reportfcntype)(const std::string&, const std::string&, int);
+  // directories found by walk, with the path, the file name, the depth, the
+  // result of stat on the item (symlinks are already followed) and the tag
+  // given to walk. the
+  // full name of the file is only built by the callback, if it needs it. if
+  // more than one thread is used, it may be called concurrently from several
+  // threads and must be thread safe.
+  typedef int (*reportfcntype)(const std::string&,
+                               const char*,
+                               int,
+                               const struct stat&,
+                               int);
 
   // called when a regular file or a symlink is encountered
   reportfcntype m_callback;
 
+  // passed on to m_callback, set by walk
+  int m_tag;
+
   // a function that is called from walk when a non-directory is encountered
   // for instance,if walk("/path/to/a/file.ext") is called instead of
   // walk("/path/to/a/")
   int handlepossiblefile(const std::string& possiblefile, int recursionlevel);
 
+  /**
+   * reads the content of directory dir, reports files to the callback
+   * and invokes onsubdir(path,fd,recursionlevel) for each item that should be
+   * descended into.
+   * @param fd the directory opened by opensubdir, or -1 to open it by path.
+   * ownership is taken.
+   * @return 2 if dir was a directory, 1 if it was something else.
+   */
+  template<class Onsubdir>
+  int readdirectory(const std::string& dir,
+                    int fd,
+                    int recursionlevel,
+                    Onsubdir onsubdir);
+
+  // opens the subdirectory name of the directory dirfd if the budget
+  // allows, returns -1 otherwise
+  int opensubdir(int dirfd, const char* name);
+
 public:
-  // find all files on a specific place
-  int walk(const std::string& dir, const int recursionlevel = 0);
+  // find all files on a specific place. the directories found are queued
+  // instead of recursed into, so the depth is not limited by the stack.
+  // with more than one thread, the queue is split among the threads which
+  // steal work from each other. tag is passed on to the callback, to tell
+  // walks apart. walk may not be called concurrently on the same object.
+  int walk(const std::string& dir,
+           const int recursionlevel = 0,
+           const int tag = 0);
 
   // to set the report functions
   void setcallbackfcn(reportfcntype reportfcn) { m_callback = reportfcn; }
+
+  // sets the number of threads used by walk. zero is treated as one.
+  void setnthreads(unsigned nthreads) { m_nthreads = nthreads ? nthreads : 1; }
+
+  // sets how many levels below the starting point directories are read,
+  // 0 means only the starting point. negative means no limit.
+  void setmaxdepth(int maxdepth) { m_maxdepth = maxdepth; }
+
+  // sets the traversal order
+  void setorder(ordertype order) { m_order = order; }
+
+  // skips files matching pattern, a shell glob matched against the file
+  // name, or against the path if the pattern contains a slash
+  void addexclude(const std::string& pattern) { m_excludefiles.add(pattern); }
+
+  // skips directories matching pattern, as addexclude. they are not read.
+  void addexcludedir(const std::string& pattern)
+  {
+    m_excludedirs.add(pattern);
+  }
+
+  // uses snapshot to skip reading unchanged directories, and stores the
+  // directories read in it. it must outlive the calls to walk.
+  void setsnapshot(Snapshot* snapshot) { m_snapshot = snapshot; }
+
+  // sets how directories are read. buffersize is the size in bytes of the
+  // buffer used for each directory with readertype::GETDENTS.
+  void setreader(readertype reader, std::size_t buffersize)
+  {
+    m_reader = reader;
+    m_buffersize = buffersize;
+  }
+
+  // sets how the entries of directories are statted
+  void setstatengine(statenginetype engine) { m_statengine = engine; }
 };
 
 #endif
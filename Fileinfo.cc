@@ -10,7 +10,6 @@
 #include <cassert>
 #include <cerrno>   //for errno
 #include <cstring>  //for strerror
-#include <fstream>  //for file reading
 #include <iostream> //for cout etc
 
 // os
@@ -20,45 +19,174 @@
 // project
 #include "Checksum.hh" //checksum calculation
 #include "Fileinfo.hh"
+#include "Filereader.hh" //for file reading
+#include "Mixbits.hh"
 #include "UndoableUnlink.hh"
 
+Fileinfo::Fileinfo(const std::string& name, int cmdline_index, int depth)
+  : Fileinfo(Pathtable::nodirectory, "", cmdline_index, depth)
+{
+  const auto pos = name.rfind('/');
+  if (pos == std::string::npos) {
+    m_basename = paths().addname(name.c_str());
+  } else {
+    m_dir = paths().adddirectory(name.substr(0, pos));
+    m_basename = paths().addname(name.c_str() + pos + 1);
+  }
+}
+
+Fileinfo::Fileinfo(const Compact& compact, filesizetype size)
+  : m_info()
+  , m_basename(compact.basename)
+  , m_dir(compact.dir)
+  , m_delete(false)
+  , m_duptype(duptype::DUPTYPE_UNKNOWN)
+  , m_nbytes(0)
+  , m_cmdline_index(compact.cmdline_index)
+  , m_depth(compact.depth)
+  , m_identity(0)
+  , m_somebytes(nullptr)
+{
+  m_info.stat_size = size;
+  m_info.stat_ino = compact.inode;
+  m_info.stat_dev = compact.device;
+  m_info.is_file = true;
+  m_info.is_directory = false;
+}
+
+Pathtable&
+Fileinfo::paths()
+{
+  static Pathtable table;
+  return table;
+}
+
+std::uint64_t
+Fileinfo::nameprefix() const
+{
+  std::uint64_t prefix = 0;
+  for (int i = 0; i < 8 && m_basename[i] != '\0'; ++i) {
+    prefix |= std::uint64_t{ static_cast<unsigned char>(m_basename[i]) }
+              << (56 - 8 * i);
+  }
+  return prefix;
+}
+
+std::size_t
+Fileinfo::buffersize(enum readtobuffermode filltype)
+{
+  auto checksumtype = Checksum::checksumtypes::NOTSET;
+  switch (filltype) {
+    case readtobuffermode::READ_FIRST_BYTES:
+    case readtobuffermode::READ_LAST_BYTES:
+    case readtobuffermode::READ_SAMPLED_BLOCKS:
+      return SomeByteSize;
+    case readtobuffermode::CREATE_MD5_CHECKSUM:
+      checksumtype = Checksum::checksumtypes::MD5;
+      break;
+    case readtobuffermode::CREATE_SHA1_CHECKSUM:
+      checksumtype = Checksum::checksumtypes::SHA1;
+      break;
+    case readtobuffermode::CREATE_SHA256_CHECKSUM:
+      checksumtype = Checksum::checksumtypes::SHA256;
+      break;
+    case readtobuffermode::CREATE_SHA512_CHECKSUM:
+      checksumtype = Checksum::checksumtypes::SHA512;
+      break;
+    default:
+      return 0;
+  }
+  const int digestlength = Checksum(checksumtype).getDigestLength();
+  return digestlength > 0 ? static_cast<std::size_t>(digestlength) : 0;
+}
+
+void
+Fileinfo::setbuffer(char* buffer, std::size_t size, bool keep)
+{
+  assert(size <= static_cast<std::size_t>(SomeByteSize));
+  if (keep && size > 0) {
+    assert(m_somebytes && size == m_nbytes);
+    std::memcpy(buffer, m_somebytes, size);
+  }
+  m_somebytes = buffer;
+  m_nbytes = static_cast<unsigned char>(size);
+}
+
+bool
+Fileinfo::keepsbuffer(enum readtobuffermode filltype,
+                      enum readtobuffermode lasttype,
+                      filesizetype lastlength) const
+{
+  if (lasttype == readtobuffermode::NOT_DEFINED) {
+    return false;
+  }
+  // If file is short, first bytes might be ALL bytes!
+  if (this->size() <= SomeByteSize) {
+    return true;
+  }
+  // the same checksum was made of all of the file
+  const bool checksum =
+    filltype != readtobuffermode::READ_FIRST_BYTES &&
+    filltype != readtobuffermode::READ_LAST_BYTES &&
+    filltype != readtobuffermode::READ_SAMPLED_BLOCKS;
+  return checksum && filltype == lasttype &&
+         (lastlength == 0 || this->size() <= lastlength);
+}
+
 int
 Fileinfo::fillwithbytes(enum readtobuffermode filltype,
-                        enum readtobuffermode lasttype)
+                        enum readtobuffermode lasttype,
+                        filesizetype length,
+                        filesizetype lastlength)
 {
 
   // Decide if we are going to read from file or not.
-  // If file is short, first bytes might be ALL bytes!
-  if (lasttype != readtobuffermode::NOT_DEFINED) {
-    if (this->size() <= static_cast<filesizetype>(m_somebytes.size())) {
-      // pointless to read - all bytes in the file are in the field
-      // m_somebytes, or checksum is calculated!
-      return 0;
-    }
+  if (keepsbuffer(filltype, lasttype, lastlength)) {
+    // pointless to read - all bytes in the file are in the field
+    // m_somebytes, or checksum is calculated!
+    return 0;
   }
 
   // set memory to zero
-  m_somebytes.fill('\0');
+  if (m_nbytes > 0) {
+    std::memset(m_somebytes, 0, m_nbytes);
+  }
 
-  std::fstream f1;
-  f1.open(m_filename.c_str(), std::ios_base::in);
-  if (!f1.is_open()) {
-    std::cerr << "fillwithbytes.cc: Could not open file \"" << m_filename
+  // checksums read all of the file, the others a few places
+  const bool checksum = filltype != readtobuffermode::READ_FIRST_BYTES &&
+                        filltype != readtobuffermode::READ_LAST_BYTES &&
+                        filltype != readtobuffermode::READ_SAMPLED_BLOCKS;
+  const std::string filename = name();
+  Filereader file(filename,
+                  checksum ? Filereader::access::SEQUENTIAL
+                           : Filereader::access::RANDOM);
+  if (!file.isopen()) {
+    std::cerr << "fillwithbytes.cc: Could not open file \"" << filename
               << "\"" << std::endl;
     return -1;
   }
 
+  // the size may be from a snapshot or a file list, or the file may have
+  // been written to since it was found. it can not be compared to files of
+  // the size it had then.
+  struct stat info;
+  if (!file.getinfo(info) || !S_ISREG(info.st_mode) ||
+      info.st_size != size()) {
+    std::cerr << "fillwithbytes.cc: File \"" << filename
+              << "\" changed since it was found, skipping it" << std::endl;
+    return -1;
+  }
+
   auto checksumtype = Checksum::checksumtypes::NOTSET;
   // read some bytes
   switch (filltype) {
     case readtobuffermode::READ_FIRST_BYTES:
       // read at start of file
-      f1.read(m_somebytes.data(), SomeByteSize);
+      file.readat(m_somebytes, m_nbytes, 0);
       break;
     case readtobuffermode::READ_LAST_BYTES:
       // read at end of file
-      f1.seekg(-SomeByteSize, std::ios_base::end);
-      f1.read(m_somebytes.data(), SomeByteSize);
+      file.readat(m_somebytes, m_nbytes, size() - m_nbytes);
       break;
     case readtobuffermode::CREATE_MD5_CHECKSUM:
       checksumtype = Checksum::checksumtypes::MD5;
@@ -72,6 +200,10 @@ Fileinfo::fillwithbytes(enum readtobuffermode filltype,
     case readtobuffermode::CREATE_SHA512_CHECKSUM:
       checksumtype = Checksum::checksumtypes::SHA512;
       break;
+    case readtobuffermode::READ_SAMPLED_BLOCKS:
+      // the digest of sha512 fills all of the buffer
+      samplesome(file, length);
+      break;
     default:
       std::cerr << "does not know how to do that filltype:"
                 << static_cast<long>(filltype) << std::endl;
@@ -80,20 +212,28 @@ Fileinfo::fillwithbytes(enum readtobuffermode filltype,
   if (checksumtype != Checksum::checksumtypes::NOTSET) {
     Checksum chk(checksumtype);
 
-    char buffer[4096];
-    while (f1) {
-      f1.read(buffer, sizeof(buffer));
-      // gcount is never negative, the cast is safe.
-      chk.update(static_cast<std::size_t>(f1.gcount()), buffer);
+    char buffer[1 << 16];
+    // with a length, only that many bytes are hashed
+    filesizetype left = length;
+    while (length == 0 || left > 0) {
+      std::size_t n = sizeof(buffer);
+      if (length > 0 && left < static_cast<filesizetype>(n)) {
+        n = static_cast<std::size_t>(left);
+      }
+      const long got = file.read(buffer, n);
+      if (got <= 0) {
+        break;
+      }
+      chk.update(static_cast<std::size_t>(got), buffer);
+      left -= got;
     }
 
     // store the result of the checksum calculation in somebytes
     int digestlength = chk.getDigestLength();
-    if (digestlength <= 0 ||
-        digestlength >= static_cast<int>(m_somebytes.size())) {
+    if (digestlength <= 0 || digestlength != static_cast<int>(m_nbytes)) {
       std::cerr << "wrong answer from getDigestLength! FIXME" << std::endl;
     }
-    if (chk.printToBuffer(m_somebytes.data(), m_somebytes.size())) {
+    if (chk.printToBuffer(m_somebytes, m_nbytes)) {
       std::cerr << "failed writing digest to buffer!!" << std::endl;
     }
   }
@@ -101,6 +241,40 @@ Fileinfo::fillwithbytes(enum readtobuffermode filltype,
   return 0;
 }
 
+void
+Fileinfo::samplesome(Filereader& file, filesizetype length)
+{
+  Checksum chk(Checksum::checksumtypes::SHA512);
+  char buffer[SampledBlockSize];
+  const filesizetype nblocks =
+    length > SampledBlockSize ? length / SampledBlockSize : 1;
+  if (size() <= nblocks * SampledBlockSize) {
+    // the blocks would cover all of the file
+    long got;
+    while ((got = file.read(buffer, sizeof(buffer))) > 0) {
+      chk.update(static_cast<std::size_t>(got), buffer);
+    }
+  } else {
+    // one block at a pseudo random place in each of nblocks equal parts of
+    // the file. the places only depend on the size, so they are the same for
+    // all files compared to each other.
+    const filesizetype part = size() / nblocks;
+    const auto slack = static_cast<std::uint64_t>(part - SampledBlockSize + 1);
+    for (filesizetype i = 0; i < nblocks; ++i) {
+      const std::uint64_t seed = static_cast<std::uint64_t>(size() ^ i);
+      const filesizetype offset =
+        i * part + static_cast<filesizetype>(mixbits(seed) % slack);
+      const long got = file.readat(buffer, sizeof(buffer), offset);
+      if (got > 0) {
+        chk.update(static_cast<std::size_t>(got), buffer);
+      }
+    }
+  }
+  if (chk.printToBuffer(m_somebytes, m_nbytes)) {
+    std::cerr << "failed writing digest to buffer!!" << std::endl;
+  }
+}
+
 bool
 Fileinfo::readfileinfo()
 {
@@ -108,9 +282,10 @@ Fileinfo::readfileinfo()
   m_info.is_file = false;
   m_info.is_directory = false;
 
+  const std::string filename = name();
   int res;
   do {
-    res = stat(m_filename.c_str(), &info);
+    res = stat(filename.c_str(), &info);
   } while (res < 0 && errno == EINTR);
 
   if (res < 0) {
@@ -119,10 +294,17 @@ Fileinfo::readfileinfo()
     m_info.stat_dev = 0;
     std::cerr << "readfileinfo.cc:Something went wrong when reading file "
                  "info from \""
-              << m_filename << "\" :" << std::strerror(errno) << std::endl;
+              << filename << "\" :" << std::strerror(errno) << std::endl;
     return false;
   }
 
+  fillfileinfo(info);
+  return true;
+}
+
+void
+Fileinfo::fillfileinfo(const struct stat& info)
+{
   // only keep the relevant information
   m_info.stat_size = info.st_size;
   m_info.stat_ino = info.st_ino;
@@ -130,7 +312,6 @@ Fileinfo::readfileinfo()
 
   m_info.is_file = S_ISREG(info.st_mode);
   m_info.is_directory = S_ISDIR(info.st_mode);
-  return true;
 }
 
 const char*
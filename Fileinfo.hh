@@ -7,13 +7,18 @@
 #ifndef Fileinfo_hh
 #define Fileinfo_hh
 
-#include <array>
 #include <cstdint>
 #include <string>
 
 // os specific headers
+#include <sys/stat.h>  //for struct stat
 #include <sys/types.h> //for off_t and others.
 
+// project
+#include "Pathtable.hh"
+
+class Filereader;
+
 /**
  Holds information about a file.
  Keeping this small is probably beneficial for performance, because the
@@ -22,22 +27,51 @@
 class Fileinfo
 {
 public:
-  // constructor
-  Fileinfo(std::string name, int cmdline_index, int depth)
+  // constructor, for the file name in directory dir of paths()
+  Fileinfo(Pathtable::dirid dir, const char* name, int cmdline_index, int depth)
     : m_info()
-    , m_filename(std::move(name))
+    , m_basename(paths().addname(name))
+    , m_dir(dir)
     , m_delete(false)
     , m_duptype(duptype::DUPTYPE_UNKNOWN)
+    , m_nbytes(0)
     , m_cmdline_index(cmdline_index)
     , m_depth(depth)
     , m_identity(0)
-  {
-    m_somebytes.fill('\0');
-  }
+    , m_somebytes(nullptr)
+  {}
+
+  // constructor, for a file given by its full path
+  Fileinfo(const std::string& name, int cmdline_index, int depth);
 
   /// for storing file size in bytes, defined in sys/types.h
   using filesizetype = off_t;
 
+  /// what is needed to recreate the Fileinfo of a regular file, in less
+  /// space. the size is left out, it is kept by whoever holds these.
+  struct Compact
+  {
+    const char* basename;
+    unsigned long inode;
+    unsigned long device;
+    Pathtable::dirid dir;
+    int cmdline_index;
+    int depth;
+  };
+
+  // constructor, recreates the Fileinfo of a regular file
+  Fileinfo(const Compact& compact, filesizetype size);
+
+  /// gets the compact form. only valid for regular files.
+  Compact compact() const
+  {
+    return Compact{ m_basename,       m_info.stat_ino, m_info.stat_dev, m_dir,
+                    m_cmdline_index, m_depth };
+  }
+
+  /// the table all names are stored in
+  static Pathtable& paths();
+
   // enums used to tell how to read data into the buffer
   enum class readtobuffermode : signed char
   {
@@ -48,8 +82,13 @@ public:
     CREATE_SHA1_CHECKSUM,
     CREATE_SHA256_CHECKSUM,
     CREATE_SHA512_CHECKSUM,
+    // a checksum of blocks spread over the file
+    READ_SAMPLED_BLOCKS,
   };
 
+  /// the size of the blocks read by READ_SAMPLED_BLOCKS
+  static const int SampledBlockSize = 4096;
+
   // type of duplicate
   enum class duptype : char
   {
@@ -77,6 +116,12 @@ public:
    */
   bool readfileinfo();
 
+  /**
+   * fills in info about the file from the result of an earlier call to stat,
+   * without querying the filesystem again.
+   */
+  void fillfileinfo(const struct stat& info);
+
   duptype getduptype() const { return m_duptype; }
 
   /// makes a symlink of "this" that points to A.
@@ -124,8 +169,21 @@ public:
   // returns the device
   unsigned long device() const { return m_info.stat_dev; }
 
-  // gets the filename
-  const std::string& name() const { return m_filename; }
+  // gets the filename, including path. it is built on each call.
+  std::string name() const { return paths().path(m_dir, m_basename); }
+
+  // gets the directory the file is in, in paths()
+  Pathtable::dirid directory() const { return m_dir; }
+
+  // the first eight bytes of the name without path as a number, which is
+  // ordered like the names are unless it is equal
+  [[gnu::pure]] std::uint64_t nameprefix() const;
+
+  // compares the names of a and b, as comparing name() would
+  static int comparenames(const Fileinfo& a, const Fileinfo& b)
+  {
+    return paths().compare(a.m_dir, a.m_basename, b.m_dir, b.m_basename);
+  }
 
   // gets the command line index this item was found at
   int get_cmdline_index() const { return m_cmdline_index; }
@@ -136,18 +194,52 @@ public:
   /**
    * fills with bytes from the file. if lasttype is supplied,
    * it is used to see if the file needs to be read again - useful if the file
-   * is shorter than the length of the bytes field.
+   * is shorter than the length of the bytes field, or if lasttype already
+   * was the same checksum of all of the file.
    * @param filltype
    * @param lasttype
-   * @return zero on success
+   * @param length for checksums, the number of bytes from the start of the
+   * file to include, zero for all of them. for READ_SAMPLED_BLOCKS, the
+   * number of bytes to sample, in blocks of SampledBlockSize.
+   * @param lastlength the length lasttype was used with
+   * @return zero on success, nonzero if the file could not be read or no
+   * longer has the size it was found with. it must not be compared then.
    */
   int fillwithbytes(enum readtobuffermode filltype,
-                    enum readtobuffermode lasttype);
+                    enum readtobuffermode lasttype,
+                    filesizetype length = 0,
+                    filesizetype lastlength = 0);
+
+  /// true if fillwithbytes keeps the buffer as it is instead of reading the
+  /// file, see fillwithbytes.
+  [[gnu::pure]] bool keepsbuffer(enum readtobuffermode filltype,
+                                 enum readtobuffermode lasttype,
+                                 filesizetype lastlength) const;
+
+  /// the size of the buffer needed by fillwithbytes for filltype, for files
+  /// larger than what is read in full by the first stage
+  static std::size_t buffersize(enum readtobuffermode filltype);
+
+  /// the size of the buffer this file needs, given the result of
+  /// buffersize(). small files are held in full instead.
+  std::size_t buffersize(std::size_t stagesize) const
+  {
+    return size() <= SomeByteSize ? static_cast<std::size_t>(size())
+                                  : stagesize;
+  }
+
+  /**
+   * sets where fillwithbytes stores its result. the buffer holds size bytes,
+   * as given by buffersize, and is owned by the caller. if keep is set, the
+   * content of the current buffer, which must have the same size, is copied
+   * to the new one.
+   */
+  void setbuffer(char* buffer, std::size_t size, bool keep);
 
   /// get a pointer to the bytes read from the file
-  const char* getbyteptr() const { return m_somebytes.data(); }
+  const char* getbyteptr() const { return m_somebytes; }
 
-  std::size_t getbuffersize() const { return m_somebytes.size(); }
+  std::size_t getbuffersize() const { return m_nbytes; }
 
   /// returns true if file is a regular file. call readfileinfo first!
   bool isRegularFile() const { return m_info.is_file; }
@@ -156,6 +248,10 @@ public:
   bool isDirectory() const { return m_info.is_directory; }
 
 private:
+  // fills the buffer with a checksum of blocks spread over file, for
+  // READ_SAMPLED_BLOCKS
+  void samplesome(Filereader& file, filesizetype length);
+
   // to store info about the file
   struct Fileinfostat
   {
@@ -168,14 +264,20 @@ private:
   };
   Fileinfostat m_info;
 
-  // to keep the name of the file, including path
-  std::string m_filename;
+  // the name of the file, without path. it is owned by paths().
+  const char* m_basename;
+
+  // the directory the file is in
+  Pathtable::dirid m_dir;
 
   // to be deleted or not
   bool m_delete;
 
   duptype m_duptype;
 
+  /// the size of m_somebytes, kept here where it fits in the padding
+  unsigned char m_nbytes;
+
   // If two files are found to be identical, the one with highest ranking is
   // chosen. The rules are listed in the man page.
   // lowest cmdlineindex wins, followed by the lowest depth, then first found.
@@ -200,8 +302,9 @@ private:
 
   static const int SomeByteSize = 64;
 
-  /// a buffer that will be filled with some bytes of the file or a hash
-  std::array<char, SomeByteSize> m_somebytes;
+  /// a buffer that will be filled with some bytes of the file or a hash.
+  /// it is set by setbuffer, only for files that are read.
+  char* m_somebytes;
 };
 
 #endif
@@ -0,0 +1,117 @@
+/*
+   copyright 2026 Paul Dreik
+   Distributed under GPL v 2.0 or later, at your option.
+   See LICENSE for further details.
+*/
+
+#include "config.h"
+
+// std
+#include <cerrno>
+
+// os
+#include <fcntl.h>
+#include <unistd.h>
+
+// project
+#include "Filereader.hh"
+
+namespace {
+// the pages behind a sequential read are dropped in steps of this many bytes
+const off_t dropstep = 1 << 20;
+} // namespace
+
+Filereader::Filereader(const std::string& name, access how)
+  : m_fd(open(name))
+  , m_access(how)
+  , m_offset(0)
+  , m_dropped(0)
+{
+#ifdef HAVE_POSIX_FADVISE
+  // the advice is only a hint, failing is harmless
+  if (m_fd >= 0) {
+    (void)posix_fadvise(m_fd,
+                        0,
+                        0,
+                        how == access::SEQUENTIAL ? POSIX_FADV_SEQUENTIAL
+                                                  : POSIX_FADV_RANDOM);
+  }
+#endif
+}
+
+Filereader::~Filereader()
+{
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
+}
+
+int
+Filereader::open(const std::string& name)
+{
+  const auto tryopen = [&name](int flags) {
+    int fd;
+    do {
+      fd = ::open(name.c_str(), flags);
+    } while (fd < 0 && errno == EINTR);
+    return fd;
+  };
+#ifdef O_NOATIME
+  // not updating the access time is only allowed for the owner of the file
+  const int fd = tryopen(O_RDONLY | O_CLOEXEC | O_NOATIME);
+  if (fd >= 0 || errno != EPERM) {
+    return fd;
+  }
+#endif
+  return tryopen(O_RDONLY | O_CLOEXEC);
+}
+
+bool
+Filereader::getinfo(struct stat& info) const
+{
+  int ret;
+  do {
+    ret = fstat(m_fd, &info);
+  } while (ret < 0 && errno == EINTR);
+  return ret == 0;
+}
+
+long
+Filereader::readat(char* buffer, std::size_t n, off_t offset)
+{
+  long total = 0;
+  while (n > 0) {
+    const ssize_t got = pread(m_fd, buffer, n, offset);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got < 0) {
+      return -1;
+    }
+    if (got == 0) {
+      break;
+    }
+    buffer += got;
+    n -= static_cast<std::size_t>(got);
+    offset += got;
+    total += got;
+  }
+  return total;
+}
+
+long
+Filereader::read(char* buffer, std::size_t n)
+{
+  const long got = readat(buffer, n, m_offset);
+  if (got > 0) {
+    m_offset += got;
+  }
+#ifdef HAVE_POSIX_FADVISE
+  if (m_access == access::SEQUENTIAL && m_offset - m_dropped >= dropstep) {
+    (void)posix_fadvise(
+      m_fd, m_dropped, m_offset - m_dropped, POSIX_FADV_DONTNEED);
+    m_dropped = m_offset;
+  }
+#endif
+  return got;
+}
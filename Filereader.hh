@@ -0,0 +1,66 @@
+/*
+   copyright 2026 Paul Dreik
+   Distributed under GPL v 2.0 or later, at your option.
+   See LICENSE for further details.
+*/
+#ifndef RDFIND_FILEREADER_HH_
+#define RDFIND_FILEREADER_HH_
+
+#include <cstddef>
+#include <string>
+
+#include <sys/stat.h>  //for struct stat
+#include <sys/types.h> //for off_t
+
+/**
+ * Reads the contents of a file through its file descriptor. The file is
+ * opened without updating its access time where possible, and the kernel
+ * is told how it will be read: a few small reads at random places need no
+ * readahead, while a sequential read gets more readahead and the pages
+ * behind it are dropped from the page cache, so hashing large files does
+ * not evict what others use.
+ */
+class Filereader
+{
+public:
+  enum class access
+  {
+    RANDOM,
+    SEQUENTIAL,
+  };
+
+  Filereader(const std::string& name, access how);
+  ~Filereader();
+  Filereader(const Filereader&) = delete;
+  Filereader& operator=(const Filereader&) = delete;
+
+  /// opens name for reading, like the constructor does
+  /// @return the file descriptor, or -1 with errno set
+  static int open(const std::string& name);
+
+  /// true if the file could be opened
+  bool isopen() const { return m_fd >= 0; }
+
+  /// gets the information of the open file, as fstat. returns false on
+  /// failure.
+  bool getinfo(struct stat& info) const;
+
+  /**
+   * reads n bytes at offset into buffer.
+   * @return the number of bytes read, fewer than n only at the end of the
+   * file, or -1 on errors
+   */
+  long readat(char* buffer, std::size_t n, off_t offset);
+
+  /// reads the next n bytes, as readat. see the class description.
+  long read(char* buffer, std::size_t n);
+
+private:
+  int m_fd;
+  access m_access;
+  // where read continues, and up to where the pages have been dropped
+  off_t m_offset;
+  off_t m_dropped;
+};
+
+#endif /* RDFIND_FILEREADER_HH_ */
@@ -0,0 +1,83 @@
+/*
+   copyright 2026 Paul Dreik
+   Distributed under GPL v 2.0 or later, at your option.
+   See LICENSE for further details.
+*/
+
+#include "config.h"
+
+// std
+#include <cstring>
+
+// os
+#include <fnmatch.h>
+
+// project
+#include "Globmatcher.hh"
+
+namespace {
+// true if s has no characters with special meaning to fnmatch
+bool
+isliteral(const std::string& s)
+{
+  return s.find_first_of("*?[\\") == std::string::npos;
+}
+} // namespace
+
+void
+Globmatcher::add(const std::string& pattern)
+{
+  m_empty = false;
+  if (pattern.find('/') != std::string::npos) {
+    m_pathglobs.push_back(pattern);
+  } else if (isliteral(pattern)) {
+    m_names.insert(pattern);
+  } else if (pattern.size() > 1 && pattern.front() == '*' &&
+             isliteral(pattern.substr(1))) {
+    m_suffixes.push_back(pattern.substr(1));
+  } else if (pattern.size() > 1 && pattern.back() == '*' &&
+             isliteral(pattern.substr(0, pattern.size() - 1))) {
+    m_prefixes.push_back(pattern.substr(0, pattern.size() - 1));
+  } else {
+    m_nameglobs.push_back(pattern);
+  }
+}
+
+bool
+Globmatcher::matches(const std::string& dir, const char* name) const
+{
+  if (m_empty) {
+    return false;
+  }
+  const std::size_t length = std::strlen(name);
+  if (!m_names.empty() && m_names.count(std::string(name, length)) != 0) {
+    return true;
+  }
+  for (const auto& suffix : m_suffixes) {
+    if (suffix.size() <= length &&
+        0 == std::memcmp(
+               name + length - suffix.size(), suffix.data(), suffix.size())) {
+      return true;
+    }
+  }
+  for (const auto& prefix : m_prefixes) {
+    if (prefix.size() <= length &&
+        0 == std::memcmp(name, prefix.data(), prefix.size())) {
+      return true;
+    }
+  }
+  for (const auto& glob : m_nameglobs) {
+    if (0 == fnmatch(glob.c_str(), name, 0)) {
+      return true;
+    }
+  }
+  if (!m_pathglobs.empty()) {
+    const std::string path = dir + "/" + name;
+    for (const auto& glob : m_pathglobs) {
+      if (0 == fnmatch(glob.c_str(), path.c_str(), 0)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
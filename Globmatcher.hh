@@ -0,0 +1,51 @@
+/*
+   copyright 2026 Paul Dreik
+   Distributed under GPL v 2.0 or later, at your option.
+   See LICENSE for further details.
+*/
+#ifndef RDFIND_GLOBMATCHER_HH_
+#define RDFIND_GLOBMATCHER_HH_
+
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * Matches names against a set of shell glob patterns, as used by fnmatch.
+ * The patterns are sorted by kind when added, so the common cases of a
+ * plain name ("node_modules"), a suffix ("*.o") or a prefix ("tmp*") are
+ * checked without fnmatch. A pattern containing a slash is matched against
+ * the path of the item instead of only its name.
+ * Matching is thread safe, adding is not.
+ */
+class Globmatcher
+{
+public:
+  /// adds pattern to the set
+  void add(const std::string& pattern);
+
+  /// true if no patterns were added
+  bool empty() const { return m_empty; }
+
+  /**
+   * true if any of the patterns matches the item name in directory dir.
+   * the path of the item is dir + "/" + name.
+   */
+  bool matches(const std::string& dir, const char* name) const;
+
+private:
+  bool m_empty = true;
+
+  // patterns without wildcards
+  std::unordered_set<std::string> m_names;
+
+  // patterns on the form *literal and literal*, without the star
+  std::vector<std::string> m_suffixes;
+  std::vector<std::string> m_prefixes;
+
+  // anything else, matched against the name or the path with fnmatch
+  std::vector<std::string> m_nameglobs;
+  std::vector<std::string> m_pathglobs;
+};
+
+#endif /* RDFIND_GLOBMATCHER_HH_ */
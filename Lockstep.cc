@@ -0,0 +1,227 @@
+/*
+   copyright 2026 Paul Dreik
+   Distributed under GPL v 2.0 or later, at your option.
+   See LICENSE for further details.
+*/
+
+#include "config.h"
+
+// std
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+// os
+#include <sys/stat.h>
+#include <unistd.h>
+
+// project
+#include "Filereader.hh"
+#include "Lockstep.hh"
+
+namespace {
+// the memory for the chunks of all files in a part of a group, and the
+// limits for the size of a chunk
+const std::size_t chunkbudget = 1 << 26;
+const std::size_t minchunk = 1 << 12;
+const std::size_t maxchunk = 1 << 20;
+
+// parts with more files than fit in the budget with the smallest chunks are
+// not read all at once. they are split on whether the files are equal to
+// the first of them, which only needs two chunks.
+const std::size_t maxbatch = chunkbudget / minchunk;
+
+// the files of larger groups are not all kept open, they are opened for
+// each chunk instead
+const std::size_t maxopen = 64;
+
+// reads n bytes at offset of fd into buffer. false on errors, or if the file
+// ends before.
+bool
+readfully(int fd, char* buffer, std::size_t n, off_t offset)
+{
+  while (n > 0) {
+    const ssize_t got = pread(fd, buffer, n, offset);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      return false;
+    }
+    buffer += got;
+    n -= static_cast<std::size_t>(got);
+    offset += got;
+  }
+  return true;
+}
+
+// true if fd is a regular file of size bytes. the file may have been
+// written to since it was found, and can not be compared to files of the
+// size it had then.
+bool
+hassize(int fd, off_t size)
+{
+  struct stat info;
+  int ret;
+  do {
+    ret = fstat(fd, &info);
+  } while (ret < 0 && errno == EINTR);
+  return ret == 0 && S_ISREG(info.st_mode) && info.st_size == size;
+}
+} // namespace
+
+Lockstep::Lockstep(long nsecsleep)
+  : m_nsecsleep(nsecsleep)
+{}
+
+std::vector<std::size_t>
+Lockstep::compare(const std::vector<std::string>& names, off_t size) const
+{
+  const std::size_t n = names.size();
+  std::vector<std::size_t> result(n, unique);
+  if (n < 2) {
+    return result;
+  }
+  // grows as needed, up to chunkbudget
+  std::vector<char> data;
+
+  // the files are kept open while they are read, unless there are too many
+  const bool keepopen = n <= maxopen;
+  std::vector<int> fds(n, -1);
+  const auto closefile = [&fds](std::size_t file) {
+    if (fds[file] >= 0) {
+      close(fds[file]);
+      fds[file] = -1;
+    }
+  };
+
+  // reads length bytes at offset of file into buffer. a file that can not
+  // be read, or no longer has size bytes, is reported and left out by the
+  // caller.
+  const auto duration = std::chrono::nanoseconds{ m_nsecsleep };
+  const auto readchunk =
+    [&](std::size_t file, char* buffer, std::size_t length, off_t offset) {
+      bool changed = false;
+      if (fds[file] < 0) {
+        fds[file] = Filereader::open(names[file]);
+        changed = fds[file] >= 0 && !hassize(fds[file], size);
+      }
+      const bool ok = fds[file] >= 0 && !changed &&
+                      readfully(fds[file], buffer, length, offset);
+      if (!ok || !keepopen) {
+        closefile(file);
+      }
+      if (changed) {
+        std::cerr << "File \"" << names[file]
+                  << "\" changed since it was found, skipping it" << std::endl;
+      } else if (!ok) {
+        std::cerr << "Could not read file \"" << names[file] << "\""
+                  << std::endl;
+      }
+      if (m_nsecsleep > 0) {
+        std::this_thread::sleep_for(duration);
+      }
+      return ok;
+    };
+
+  // the parts of the group left to compare, as positions in names, and the
+  // number of bytes they are known to have in common
+  struct Part
+  {
+    std::vector<std::size_t> files;
+    off_t offset;
+  };
+  std::vector<Part> parts(1);
+  for (std::size_t i = 0; i < n; ++i) {
+    parts.front().files.push_back(i);
+  }
+  parts.front().offset = 0;
+
+  std::vector<std::size_t> readable;
+  while (!parts.empty()) {
+    Part part = std::move(parts.back());
+    parts.pop_back();
+    const std::size_t m = part.files.size();
+    if (m < 2 || part.offset >= size) {
+      // alone, or identical to the others all the way
+      if (m >= 2) {
+        for (const auto file : part.files) {
+          result[file] = part.files.front();
+        }
+      }
+      std::for_each(part.files.begin(), part.files.end(), closefile);
+      continue;
+    }
+
+    const bool large = m > maxbatch;
+    const std::size_t chunk =
+      large ? maxchunk : std::min(maxchunk, chunkbudget / m);
+    const off_t left = size - part.offset;
+    const std::size_t length = left < static_cast<off_t>(chunk)
+                                 ? static_cast<std::size_t>(left)
+                                 : chunk;
+    const off_t offset = part.offset + static_cast<off_t>(length);
+
+    if (large) {
+      // the files equal to the first readable one go on, the others are
+      // compared again from the same place
+      data.resize(std::max(data.size(), 2 * length));
+      char* const first = data.data();
+      char* const other = data.data() + length;
+      Part same{ {}, offset };
+      Part different{ {}, part.offset };
+      std::size_t k = 0;
+      while (k < m && !readchunk(part.files[k], first, length, part.offset)) {
+        ++k;
+      }
+      if (k < m) {
+        same.files.push_back(part.files[k++]);
+      }
+      for (; k < m; ++k) {
+        const std::size_t file = part.files[k];
+        if (readchunk(file, other, length, part.offset)) {
+          (std::memcmp(first, other, length) == 0 ? same : different)
+            .files.push_back(file);
+        }
+      }
+      parts.push_back(std::move(different));
+      parts.push_back(std::move(same));
+      continue;
+    }
+
+    // read the next chunk of each file, at its position in the part
+    data.resize(std::max(data.size(), m * length));
+    const auto chunkof = [&data, length](std::size_t k) {
+      return data.data() + k * length;
+    };
+    readable.clear();
+    for (std::size_t k = 0; k < m; ++k) {
+      if (readchunk(part.files[k], chunkof(k), length, part.offset)) {
+        readable.push_back(k);
+      }
+    }
+
+    // split into parts with equal chunks, which keep their order
+    std::stable_sort(
+      readable.begin(), readable.end(), [&](std::size_t a, std::size_t b) {
+        return std::memcmp(chunkof(a), chunkof(b), length) < 0;
+      });
+    for (auto first = readable.begin(); first != readable.end();) {
+      auto last = first + 1;
+      while (last != readable.end() &&
+             std::memcmp(chunkof(*first), chunkof(*last), length) == 0) {
+        ++last;
+      }
+      Part next{ {}, offset };
+      for (auto it = first; it != last; ++it) {
+        next.files.push_back(part.files[*it]);
+      }
+      parts.push_back(std::move(next));
+      first = last;
+    }
+  }
+  return result;
+}
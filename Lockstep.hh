@@ -0,0 +1,47 @@
+/*
+   copyright 2026 Paul Dreik
+   Distributed under GPL v 2.0 or later, at your option.
+   See LICENSE for further details.
+*/
+#ifndef RDFIND_LOCKSTEP_HH_
+#define RDFIND_LOCKSTEP_HH_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <sys/types.h> //for off_t
+
+/**
+ * Compares files of equal size byte by byte, without checksums. All files
+ * of a group are read together, one chunk at a time, and the group is split
+ * as soon as their contents differ. A file that is alone in its part is not
+ * read any further, so a file is only read up to where it differs from all
+ * others. The chunks held at once stay within a fixed budget: a part of a
+ * group with too many files to hold a chunk of each is instead split on
+ * whether its files are equal to the first of them. At most a few files
+ * are held open, larger groups are opened for each chunk.
+ */
+class Lockstep
+{
+public:
+  /// nsecsleep nanoseconds are slept after each chunk read
+  explicit Lockstep(long nsecsleep);
+
+  /// marks files that are not identical to any other
+  static const std::size_t unique = static_cast<std::size_t>(-1);
+
+  /**
+   * compares the files with the given names, which all have size bytes.
+   * @return for each file, the position in names of the first file with
+   * identical content, or unique. a file that can not be read, or no longer
+   * has size bytes, is unique.
+   */
+  std::vector<std::size_t> compare(const std::vector<std::string>& names,
+                                   off_t size) const;
+
+private:
+  long m_nsecsleep;
+};
+
+#endif /* RDFIND_LOCKSTEP_HH_ */
@@ -0,0 +1,171 @@
+/*
+   copyright 2026 Paul Dreik
+   Distributed under GPL v 2.0 or later, at your option.
+   See LICENSE for further details.
+*/
+
+#include "config.h"
+
+// std
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// os
+#include <fcntl.h>
+#include <unistd.h>
+
+// project
+#include "Manifest.hh"
+
+namespace {
+// the list is read in blocks of this size, the buffer grows if a single
+// record is longer
+const std::size_t blocksize = 1 << 20;
+
+// parses a decimal number followed by a space, advancing p past the space
+bool
+parsecolumn(const char*& p, unsigned long long& value)
+{
+  if (*p < '0' || *p > '9') {
+    return false;
+  }
+  char* end = nullptr;
+  errno = 0;
+  value = std::strtoull(p, &end, 10);
+  if (errno != 0 || *end != ' ') {
+    return false;
+  }
+  p = end + 1;
+  return true;
+}
+} // namespace
+
+bool
+Manifest::handlerecord(const char* record, int tag)
+{
+  struct stat info;
+  const char* path = record;
+  if (m_columns) {
+    unsigned long long size = 0;
+    unsigned long long device = 0;
+    unsigned long long inode = 0;
+    if (!parsecolumn(path, size) || !parsecolumn(path, device) ||
+        !parsecolumn(path, inode)) {
+      return false;
+    }
+    std::memset(&info, 0, sizeof(info));
+    info.st_mode = S_IFREG;
+    info.st_size = static_cast<off_t>(size);
+    info.st_dev = static_cast<dev_t>(device);
+    info.st_ino = static_cast<ino_t>(inode);
+  }
+  if (*path == '\0') {
+    return false;
+  }
+
+  // split the path in directory and name. a file directly under / keeps
+  // its full path as name, so the path is reproduced exactly.
+  const char* slash = std::strrchr(path, '/');
+  const char* name = path;
+  if (slash == nullptr || slash == path) {
+    m_dir.clear();
+  } else {
+    m_dir.assign(path, static_cast<std::size_t>(slash - path));
+    name = slash + 1;
+  }
+  if (*name == '\0') {
+    return false;
+  }
+
+  if (!m_columns) {
+    const int ret = m_followsymlinks ? stat(path, &info) : lstat(path, &info);
+    if (ret != 0) {
+      std::cerr << "failed to read file info on file \"" << path
+                << "\": " << std::strerror(errno) << '\n';
+      return true;
+    }
+  }
+  (*m_callback)(m_dir, name, 0, info, tag);
+  return true;
+}
+
+int
+Manifest::read(const std::string& file, int tag)
+{
+  const bool isstdin = file == "-";
+  const int fd =
+    isstdin ? STDIN_FILENO : open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    std::cerr << "failed to open file list \"" << file
+              << "\": " << std::strerror(errno) << '\n';
+    return -1;
+  }
+
+  // records are handled in place in the buffer. an incomplete record at
+  // the end of the buffer is moved to the start before reading more.
+  std::vector<char> buffer(blocksize);
+  std::size_t used = 0;
+  std::size_t nrecords = 0;
+  std::size_t nbad = 0;
+  int ret = 0;
+  for (;;) {
+    if (used == buffer.size()) {
+      buffer.resize(2 * buffer.size());
+    }
+    const ssize_t nread = ::read(fd, buffer.data() + used, buffer.size() - used);
+    if (nread < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "failed to read file list \"" << file
+                << "\": " << std::strerror(errno) << '\n';
+      ret = -1;
+      break;
+    }
+    if (nread == 0) {
+      // the last record may lack its terminator. it ends at used, what
+      // is after that is left from earlier blocks.
+      if (used > 0) {
+        if (used == buffer.size()) {
+          buffer.resize(buffer.size() + 1);
+        }
+        buffer[used] = '\0';
+        ++nrecords;
+        if (!handlerecord(buffer.data(), tag)) {
+          ++nbad;
+        }
+      }
+      break;
+    }
+    used += static_cast<std::size_t>(nread);
+
+    char* begin = buffer.data();
+    char* const end = buffer.data() + used;
+    for (;;) {
+      char* const stop = static_cast<char*>(
+        std::memchr(begin, '\0', static_cast<std::size_t>(end - begin)));
+      if (stop == nullptr) {
+        break;
+      }
+      ++nrecords;
+      if (!handlerecord(begin, tag)) {
+        ++nbad;
+      }
+      begin = stop + 1;
+    }
+    used = static_cast<std::size_t>(end - begin);
+    std::memmove(buffer.data(), begin, used);
+  }
+
+  if (nbad > 0) {
+    std::cerr << "ignored " << nbad << " malformed records out of " << nrecords
+              << " in file list \"" << file << "\"\n";
+  }
+  if (!isstdin) {
+    close(fd);
+  }
+  return ret;
+}
@@ -0,0 +1,57 @@
+/*
+   copyright 2026 Paul Dreik
+   Distributed under GPL v 2.0 or later, at your option.
+   See LICENSE for further details.
+*/
+#ifndef RDFIND_MANIFEST_HH_
+#define RDFIND_MANIFEST_HH_
+
+#include <string>
+
+// os specific headers
+#include <sys/stat.h>
+
+/**
+ * Reads a list of files instead of traversing directories. The list holds
+ * one record per file, each terminated by a NUL character, as written by
+ * find -print0. With columns, each record instead starts with the size,
+ * the device and the inode number of the file, separated by spaces, as
+ * written by find -printf '%s %D %i %p\0'. The files are then not statted
+ * while the list is read. The sizes are trusted until the files are read,
+ * when a file of another size is dropped.
+ */
+class Manifest
+{
+public:
+  explicit Manifest(bool followsymlinks, bool columns)
+    : m_followsymlinks(followsymlinks)
+    , m_columns(columns)
+    , m_callback(nullptr)
+  {}
+
+  /// called for each file with the directory, the file name, the depth
+  /// (always 0), the file information and the tag given to read.
+  typedef int (*reportfcntype)(const std::string&,
+                               const char*,
+                               int,
+                               const struct stat&,
+                               int);
+  void setcallbackfcn(reportfcntype reportfcn) { m_callback = reportfcn; }
+
+  /// reads the list in file, or standard input if file is "-". returns 0
+  /// on success, nonzero if the list could not be read.
+  int read(const std::string& file, int tag);
+
+private:
+  // handles one record, returns false if it was malformed
+  bool handlerecord(const char* record, int tag);
+
+  bool m_followsymlinks;
+  bool m_columns;
+  reportfcntype m_callback;
+
+  // the directory of the previous record, to avoid reallocating
+  std::string m_dir;
+};
+
+#endif /* RDFIND_MANIFEST_HH_ */
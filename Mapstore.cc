@@ -0,0 +1,106 @@
+/*
+   copyright 2026 Paul Dreik
+   Distributed under GPL v 2.0 or later, at your option.
+   See LICENSE for further details.
+*/
+
+#include "config.h"
+
+// std
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <string>
+#include <vector>
+
+// os
+#include <sys/mman.h>
+#include <unistd.h>
+
+// project
+#include "Mapstore.hh"
+
+namespace {
+std::size_t limit = 0;
+
+// each allocation starts with this, to know how to release it. it keeps
+// the alignment of what follows.
+struct alignas(std::max_align_t) Header
+{
+  std::size_t mapped; // the size of the mapping, 0 if from malloc
+};
+
+// maps a new temporary file of size bytes, or returns nullptr
+void*
+mapfile(std::size_t size)
+{
+  const char* dir = std::getenv("TMPDIR");
+  std::string name(dir && *dir ? dir : "/tmp");
+  name += "/rdfind.XXXXXX";
+  std::vector<char> buf(name.begin(), name.end());
+  buf.push_back('\0');
+  const int fd = mkstemp(buf.data());
+  if (fd < 0) {
+    return nullptr;
+  }
+  // the mapping keeps the file alive
+  (void)unlink(buf.data());
+  void* p = MAP_FAILED;
+  if (ftruncate(fd, static_cast<off_t>(size)) == 0) {
+    p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  (void)close(fd);
+  return p == MAP_FAILED ? nullptr : p;
+}
+} // namespace
+
+void
+Mapstore::setlimit(std::size_t bytes)
+{
+  limit = bytes;
+}
+
+std::size_t
+Mapstore::largest()
+{
+  return limit == 0 ? std::numeric_limits<std::size_t>::max() : limit / 4;
+}
+
+void*
+Mapstore::allocate(std::size_t bytes)
+{
+  if (bytes > std::numeric_limits<std::size_t>::max() - sizeof(Header)) {
+    throw std::bad_alloc();
+  }
+  const std::size_t size = bytes + sizeof(Header);
+  Header* h = nullptr;
+  if (bytes > largest()) {
+    h = static_cast<Header*>(mapfile(size));
+    if (h) {
+      h->mapped = size;
+    }
+  } else {
+    h = static_cast<Header*>(std::malloc(size));
+    if (h) {
+      h->mapped = 0;
+    }
+  }
+  if (!h) {
+    throw std::bad_alloc();
+  }
+  return h + 1;
+}
+
+void
+Mapstore::deallocate(void* p) noexcept
+{
+  if (!p) {
+    return;
+  }
+  Header* h = static_cast<Header*>(p) - 1;
+  if (h->mapped != 0) {
+    (void)munmap(h, h->mapped);
+  } else {
+    std::free(h);
+  }
+}
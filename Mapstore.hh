@@ -0,0 +1,67 @@
+/*
+   copyright 2026 Paul Dreik
+   Distributed under GPL v 2.0 or later, at your option.
+   See LICENSE for further details.
+*/
+#ifndef RDFIND_MAPSTORE_HH_
+#define RDFIND_MAPSTORE_HH_
+
+#include <cstddef>
+
+/**
+ * Storage for the large arrays, the file list and the keys it is sorted
+ * on. With a memory limit, arrays larger than a quarter of the limit are
+ * kept in temporary files mapped into memory instead, so the kernel can
+ * write them out and read them back as needed instead of running out of
+ * memory. The files are removed as soon as they are created.
+ */
+namespace Mapstore {
+/// sets the memory limit in bytes, 0 means no limit. must be called before
+/// anything is allocated.
+void
+setlimit(std::size_t bytes);
+
+/// the largest array, in bytes, that is kept in ordinary memory.
+[[gnu::pure]] std::size_t
+largest();
+
+/// allocates bytes of storage, throws std::bad_alloc on failure
+void*
+allocate(std::size_t bytes);
+
+/// releases storage from allocate
+void
+deallocate(void* p) noexcept;
+} // namespace Mapstore
+
+/// an allocator for standard containers, that allocates through Mapstore
+template<class T>
+class Mapallocator
+{
+public:
+  using value_type = T;
+
+  Mapallocator() = default;
+  template<class U>
+  Mapallocator(const Mapallocator<U>&)
+  {}
+
+  T* allocate(std::size_t n)
+  {
+    return static_cast<T*>(Mapstore::allocate(n * sizeof(T)));
+  }
+  void deallocate(T* p, std::size_t) noexcept { Mapstore::deallocate(p); }
+
+  template<class U>
+  bool operator==(const Mapallocator<U>&) const
+  {
+    return true;
+  }
+  template<class U>
+  bool operator!=(const Mapallocator<U>&) const
+  {
+    return false;
+  }
+};
+
+#endif /* RDFIND_MAPSTORE_HH_ */
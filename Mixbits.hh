@@ -0,0 +1,27 @@
+/*
+   copyright 2026 Paul Dreik
+   Distributed under GPL v 2.0 or later, at your option.
+   See LICENSE for further details.
+*/
+#ifndef RDFIND_MIXBITS_HH_
+#define RDFIND_MIXBITS_HH_
+
+#include <cstdint>
+
+/**
+ * scrambles the bits of x, so that every bit of the result depends on all of
+ * them and nearby inputs give unrelated outputs. this is the finalizer of
+ * murmurhash3.
+ */
+[[gnu::const]] inline std::uint64_t
+mixbits(std::uint64_t x)
+{
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+#endif /* RDFIND_MIXBITS_HH_ */
@@ -0,0 +1,241 @@
+/*
+   copyright 2026 Paul Dreik
+   Distributed under GPL v 2.0 or later, at your option.
+   See LICENSE for further details.
+*/
+
+#include "config.h"
+
+// std
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+// project
+#include "Pathtable.hh"
+
+namespace {
+// names are copied into blocks of this size, longer ones get their own
+const std::size_t blocksize = 1 << 20;
+
+// compares the names a and b as if both were followed by a slash
+int
+compareslashed(const char* a,
+               std::uint32_t lengtha,
+               const char* b,
+               std::uint32_t lengthb)
+{
+  const std::uint32_t n = std::min(lengtha, lengthb);
+  const int c = std::memcmp(a, b, n);
+  if (c != 0) {
+    return c;
+  }
+  const unsigned char nexta =
+    n < lengtha ? static_cast<unsigned char>(a[n]) : '/';
+  const unsigned char nextb =
+    n < lengthb ? static_cast<unsigned char>(b[n]) : '/';
+  return nexta - nextb;
+}
+} // namespace
+
+Pathtable::Pathtable()
+  : m_index(64, Hash{ this }, Equal{ this })
+  , m_free(nullptr)
+  , m_freesize(0)
+{
+  m_dirs.push_back(Directory{ nodirectory, 0, "" });
+}
+
+std::size_t
+Pathtable::Hash::operator()(dirid id) const
+{
+  // fnv-1a over the parent and the name
+  const Directory& d = table->m_dirs[id];
+  std::uint64_t h = 14695981039346656037ULL ^ d.parent;
+  for (std::uint32_t i = 0; i < d.length; ++i) {
+    h = (h ^ static_cast<unsigned char>(d.name[i])) * 1099511628211ULL;
+  }
+  return h;
+}
+
+bool
+Pathtable::Equal::operator()(dirid a, dirid b) const
+{
+  const Directory& da = table->m_dirs[a];
+  const Directory& db = table->m_dirs[b];
+  return da.parent == db.parent && da.length == db.length &&
+         0 == std::memcmp(da.name, db.name, da.length);
+}
+
+const char*
+Pathtable::store(const char* name, std::size_t length)
+{
+  const std::size_t needed = length + 1;
+  if (needed > m_freesize) {
+    const std::size_t size = needed > blocksize ? needed : blocksize;
+    m_blocks.emplace_back(new char[size]);
+    m_free = m_blocks.back().get();
+    m_freesize = size;
+  }
+  char* ret = m_free;
+  std::memcpy(ret, name, length);
+  ret[length] = '\0';
+  m_free += needed;
+  m_freesize -= needed;
+  return ret;
+}
+
+Pathtable::dirid
+Pathtable::lookup(dirid parent, const char* name, std::size_t length)
+{
+  // probe with a temporary entry pointing to the callers name, it is
+  // replaced with a stored copy if it is kept.
+  if (m_dirs.size() > std::numeric_limits<dirid>::max() ||
+      length > std::numeric_limits<std::uint32_t>::max()) {
+    throw std::length_error("too many directories in the path table");
+  }
+  const auto candidate = static_cast<dirid>(m_dirs.size());
+  m_dirs.push_back(
+    Directory{ parent, static_cast<std::uint32_t>(length), name });
+  const auto found = m_index.find(candidate);
+  if (found != m_index.end()) {
+    m_dirs.pop_back();
+    return *found;
+  }
+  m_dirs.back().name = store(name, length);
+  m_index.insert(candidate);
+  return candidate;
+}
+
+Pathtable::dirid
+Pathtable::adddirectory(const std::string& path)
+{
+  if (path.empty()) {
+    return nodirectory;
+  }
+  std::lock_guard<std::mutex> lock(m_mutex);
+  // add each component, the first one has no parent
+  dirid id = nodirectory;
+  std::size_t begin = 0;
+  for (;;) {
+    const auto end = path.find('/', begin);
+    const std::size_t stop = end == std::string::npos ? path.size() : end;
+    id = lookup(id, path.data() + begin, stop - begin);
+    if (end == std::string::npos) {
+      return id;
+    }
+    begin = end + 1;
+  }
+}
+
+const char*
+Pathtable::addname(const char* name)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return store(name, std::strlen(name));
+}
+
+void
+Pathtable::appendpath(dirid dir, const char* name, std::string& out) const
+{
+  // collect the directories from the innermost and out, then append them
+  // in reverse
+  thread_local std::vector<dirid> chain;
+  chain.clear();
+  for (dirid d = dir; d != nodirectory; d = m_dirs[d].parent) {
+    chain.push_back(d);
+  }
+  for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+    const Directory& d = m_dirs[*it];
+    out.append(d.name, d.length);
+    out.push_back('/');
+  }
+  out.append(name);
+}
+
+std::string
+Pathtable::path(dirid dir, const char* name) const
+{
+  std::string ret;
+  appendpath(dir, name, ret);
+  return ret;
+}
+
+int
+Pathtable::compare(dirid dira,
+                   const char* namea,
+                   dirid dirb,
+                   const char* nameb) const
+{
+  if (dira == dirb) {
+    // the paths share everything up to the name
+    return std::strcmp(namea, nameb);
+  }
+  thread_local std::string a;
+  thread_local std::string b;
+  a.clear();
+  b.clear();
+  appendpath(dira, namea, a);
+  appendpath(dirb, nameb, b);
+  return a.compare(b);
+}
+
+std::vector<Pathtable::Order>
+Pathtable::sortorder() const
+{
+  // the children of each directory, as ranges of one array
+  const std::size_t n = m_dirs.size();
+  std::vector<std::size_t> childrenstart(n + 1);
+  for (std::size_t d = 1; d < n; ++d) {
+    ++childrenstart[m_dirs[d].parent + 1];
+  }
+  for (std::size_t d = 0; d < n; ++d) {
+    childrenstart[d + 1] += childrenstart[d];
+  }
+  std::vector<dirid> children(n);
+  {
+    std::vector<std::size_t> next(childrenstart.begin(),
+                                  childrenstart.end() - 1);
+    for (std::size_t d = 1; d < n; ++d) {
+      children[next[m_dirs[d].parent]++] = static_cast<dirid>(d);
+    }
+  }
+  for (std::size_t d = 0; d < n; ++d) {
+    std::sort(children.begin() + static_cast<std::ptrdiff_t>(childrenstart[d]),
+              children.begin() +
+                static_cast<std::ptrdiff_t>(childrenstart[d + 1]),
+              [this](dirid a, dirid b) {
+                const Directory& da = m_dirs[a];
+                const Directory& db = m_dirs[b];
+                return compareslashed(da.name, da.length, db.name, db.length) <
+                       0;
+              });
+  }
+
+  // number the directories in the order they are visited, depth first with
+  // the children in sorted order. a path followed by a slash is a prefix of
+  // the paths below it, so they sort right after it.
+  std::vector<Order> order(n);
+  std::uint32_t position = 0;
+  struct Visit
+  {
+    dirid dir;
+    std::size_t nextchild;
+  };
+  std::vector<Visit> stack;
+  order[nodirectory].first = position++;
+  stack.push_back(Visit{ nodirectory, childrenstart[nodirectory] });
+  while (!stack.empty()) {
+    Visit& visit = stack.back();
+    if (visit.nextchild == childrenstart[visit.dir + 1]) {
+      order[visit.dir].last = position - 1;
+      stack.pop_back();
+      continue;
+    }
+    const dirid child = children[visit.nextchild++];
+    order[child].first = position++;
+    stack.push_back(Visit{ child, childrenstart[child] });
+  }
+  return order;
+}
@@ -0,0 +1,118 @@
+/*
+   copyright 2026 Paul Dreik
+   Distributed under GPL v 2.0 or later, at your option.
+   See LICENSE for further details.
+*/
+#ifndef RDFIND_PATHTABLE_HH_
+#define RDFIND_PATHTABLE_HH_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * Stores paths compactly. Each directory is stored once, as its parent
+ * directory and its own name, and file names are stored once in a string
+ * pool without any per string allocation. A file is then identified by
+ * its directory and its name, the full path is only built when needed.
+ *
+ * The full path of a directory is the path of its parent, a slash and its
+ * name, or only its name if it has no parent. The full path of a file is
+ * built the same way. This reproduces the path exactly as it was given,
+ * including repeated slashes.
+ *
+ * Adding is thread safe. Building paths is not safe while adding.
+ */
+class Pathtable
+{
+public:
+  /// identifies a directory. nodirectory is for names without a directory.
+  typedef std::uint32_t dirid;
+  static const dirid nodirectory = 0;
+
+  Pathtable();
+  Pathtable(const Pathtable&) = delete;
+  Pathtable& operator=(const Pathtable&) = delete;
+
+  /// adds the directory path (and its parents) if not already known. an
+  /// empty path gives nodirectory.
+  dirid adddirectory(const std::string& path);
+
+  /// stores name, the returned pointer is valid as long as the table lives.
+  const char* addname(const char* name);
+
+  /// appends the full path of name in directory dir to out
+  void appendpath(dirid dir, const char* name, std::string& out) const;
+
+  /// gets the full path of name in directory dir
+  std::string path(dirid dir, const char* name) const;
+
+  /**
+   * compares the full paths of two files, as std::string::compare would,
+   * but without building them if they are in the same directory.
+   */
+  int compare(dirid dira,
+              const char* namea,
+              dirid dirb,
+              const char* nameb) const;
+
+  /// where a directory goes when all directories are sorted on their full
+  /// path followed by a slash. the directories below it come right after
+  /// it, up to and including last.
+  struct Order
+  {
+    std::uint32_t first;
+    std::uint32_t last;
+  };
+
+  /**
+   * sorts the directories, see Order. the result is indexed by dirid. files
+   * in directories a and b, neither below the other, compare as
+   * order[a].first and order[b].first. nodirectory comes first, and all
+   * other directories are below it.
+   */
+  std::vector<Order> sortorder() const;
+
+private:
+  struct Directory
+  {
+    dirid parent;
+    std::uint32_t length;
+    const char* name;
+  };
+
+  // hashes and compares directories by their index in m_dirs
+  struct Hash
+  {
+    const Pathtable* table;
+    [[gnu::pure]] std::size_t operator()(dirid id) const;
+  };
+  struct Equal
+  {
+    const Pathtable* table;
+    [[gnu::pure]] bool operator()(dirid a, dirid b) const;
+  };
+
+  // finds or adds the directory with the given parent and name
+  dirid lookup(dirid parent, const char* name, std::size_t length);
+
+  // copies length bytes of name into the pool, adding a terminating zero
+  const char* store(const char* name, std::size_t length);
+
+  std::mutex m_mutex;
+
+  // all directories, the first entry is a placeholder for nodirectory
+  std::vector<Directory> m_dirs;
+  std::unordered_set<dirid, Hash, Equal> m_index;
+
+  // the string pool, allocated in large blocks that never move
+  std::vector<std::unique_ptr<char[]>> m_blocks;
+  char* m_free;
+  std::size_t m_freesize;
+};
+
+#endif /* RDFIND_PATHTABLE_HH_ */
@@ -9,17 +9,25 @@
 
 // std
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
+#include <cstdint>
 #include <cstring>
 #include <fstream>  //for file writing
+#include <functional>
 #include <iostream> //for std::cerr
 #include <ostream>  //for output
 #include <string>   //for easier passing of string arguments
 #include <thread>   //sleep
+#include <tuple>
+#include <utility>
 
 // project
+#include "Devices.hh"
 #include "Fileinfo.hh" //file container
+#include "Lockstep.hh"
+#include "Mixbits.hh"
 #include "RdfindDebug.hh"
 
 // class declaration
@@ -44,7 +52,7 @@ Rdutil::printtofile(const std::string& filename) const
   output << "# Automatically generated\n";
   output << "# duptype id depth size device inode priority name\n";
 
-  std::vector<Fileinfo>::iterator it;
+  Filelist::iterator it;
   for (it = m_list.begin(); it != m_list.end(); ++it) {
     output << Fileinfo::getduptypestring(*it) << " " << it->getidentity() << " "
            << it->depth() << " " << it->size() << " " << it->device() << " "
@@ -61,7 +69,7 @@ Rdutil::printtofile(const std::string& filename) const
 // returns how many times the function was invoked.
 template<typename Function>
 std::size_t
-applyactiononfile(std::vector<Fileinfo>& m_list, Function f)
+applyactiononfile(Filelist& m_list, Function f)
 {
 
   const auto first = m_list.begin();
@@ -188,12 +196,411 @@ Rdutil::markitems()
 }
 
 namespace {
-bool
-cmpDeviceInode(const Fileinfo& a, const Fileinfo& b)
+// fewer elements than this per thread are not worth starting threads for
+const std::size_t minperthread = 1 << 16;
+
+// groups of at least this many files have their files read concurrently,
+// instead of being read concurrently with other groups
+const std::size_t largegroup = 256;
+
+// the number of threads to use for n elements, given at most nthreads
+unsigned
+threadsfor(std::size_t n, unsigned nthreads)
+{
+  const std::size_t useful = n / minperthread;
+  return useful < nthreads ? (useful ? static_cast<unsigned>(useful) : 1U)
+                           : nthreads;
+}
+
+/**
+ * invokes f(i) for each i in 0..n-1, on nthreads threads including the
+ * calling one. each thread takes the next i in turn.
+ */
+template<class F>
+void
+parallelfor(std::size_t n, unsigned nthreads, F f)
 {
-  return std::make_tuple(a.device(), a.inode()) <
-         std::make_tuple(b.device(), b.inode());
+  if (nthreads <= 1 || n <= 1) {
+    for (std::size_t i = 0; i < n; ++i) {
+      f(i);
+    }
+    return;
+  }
+  std::atomic<std::size_t> next(0);
+  auto worker = [&]() {
+    for (std::size_t i; (i = next++) < n;) {
+      f(i);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (std::size_t t = 1; t < std::min<std::size_t>(nthreads, n); ++t) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+/**
+ * invokes read(k) for each k in 0..n-1, which are in device order with
+ * deviceof(k) the device of k. the devices are read concurrently, each by
+ * threadsof(device) threads taking the next k of the device in turn, so the
+ * order within a device is kept as far as possible.
+ */
+template<class Deviceof, class Threadsof, class Read>
+void
+readbydevice(std::size_t n, Deviceof deviceof, Threadsof threadsof, Read read)
+{
+  struct Devicerange
+  {
+    std::size_t first;
+    std::size_t last;
+    unsigned nthreads;
+  };
+  std::vector<Devicerange> ranges;
+  unsigned nthreads = 0;
+  for (std::size_t first = 0; first != n;) {
+    std::size_t last = first + 1;
+    while (last != n && deviceof(last) == deviceof(first)) {
+      ++last;
+    }
+    ranges.push_back(Devicerange{ first, last, threadsof(deviceof(first)) });
+    nthreads += ranges.back().nthreads;
+    first = last;
+  }
+
+  if (nthreads <= 1) {
+    for (std::size_t k = 0; k < n; ++k) {
+      read(k);
+    }
+    return;
+  }
+
+  std::vector<std::atomic<std::size_t>> next(ranges.size());
+  for (std::size_t i = 0; i < ranges.size(); ++i) {
+    next[i] = ranges[i].first;
+  }
+  auto worker = [&](std::size_t i) {
+    for (std::size_t k; (k = next[i]++) < ranges[i].last;) {
+      read(k);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < ranges.size(); ++i) {
+    for (unsigned j = 0; j < ranges[i].nthreads; ++j) {
+      threads.emplace_back(worker, i);
+    }
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
 }
+
+/**
+ * the number of threads each device of a list is read by: readthreads, except
+ * for rotating disks which are read by one.
+ */
+struct Devicethreads
+{
+  Devicethreads(const Filelist& list, unsigned readthreads)
+  {
+    for (const auto& elem : list) {
+      const unsigned long device = elem.device();
+      if (std::none_of(devices.begin(),
+                       devices.end(),
+                       [device](const std::pair<unsigned long, unsigned>& d) {
+                         return d.first == device;
+                       })) {
+        devices.emplace_back(
+          device,
+          Devices::isrotational(device) ? 1U : std::max(readthreads, 1U));
+      }
+    }
+  }
+
+  unsigned operator()(unsigned long device) const
+  {
+    for (const auto& d : devices) {
+      if (d.first == device) {
+        return d.second;
+      }
+    }
+    return 1U;
+  }
+
+  std::vector<std::pair<unsigned long, unsigned>> devices;
+};
+
+/**
+ * sorts v with less. if v is larger than Mapstore::largest, it is sorted in
+ * runs of that size which are then merged pairwise, so the work is done on
+ * a bounded part of v at a time and the merges read and write sequentially.
+ * with more than one thread, the runs are also no larger than a share of v
+ * per thread. they are sorted concurrently, and each merge is split into
+ * pieces so the threads share the last merges too. the result is the same
+ * as with one thread.
+ */
+template<class Vector, class Less>
+void
+sortinruns(Vector& v, Less less, unsigned nthreads = 1)
+{
+  const std::size_t n = v.size();
+  nthreads = threadsfor(n, nthreads);
+  std::size_t run =
+    std::max<std::size_t>(1, Mapstore::largest() / sizeof(v.front()));
+  run = std::min(run, (n + nthreads - 1) / nthreads);
+  if (n <= run) {
+    std::sort(v.begin(), v.end(), less);
+    return;
+  }
+  const auto at = [&v](std::size_t i) {
+    return v.begin() + static_cast<std::ptrdiff_t>(i);
+  };
+  parallelfor((n + run - 1) / run, nthreads, [&](std::size_t i) {
+    std::sort(at(i * run), at(std::min(i * run + run, n)), less);
+  });
+  Vector other(n);
+  for (std::size_t width = run; width < n; width *= 2) {
+    const std::size_t npairs = (n + 2 * width - 1) / (2 * width);
+    const std::size_t npieces = std::max<std::size_t>(1, nthreads / npairs);
+    parallelfor(npairs * npieces, nthreads, [&](std::size_t k) {
+      const std::size_t first = k / npieces * 2 * width;
+      const std::size_t piece = k % npieces;
+      const auto a = at(first);
+      const auto b = at(std::min(first + width, n));
+      const auto c = at(std::min(first + 2 * width, n));
+      // split [a,b) evenly, and [b,c) where the split points would go
+      const auto lengtha = b - a;
+      const auto pa = static_cast<std::ptrdiff_t>(piece);
+      const auto na = static_cast<std::ptrdiff_t>(npieces);
+      const auto a1 = a + lengtha * pa / na;
+      const auto a2 = a + lengtha * (pa + 1) / na;
+      const auto b1 = piece == 0 ? b : std::lower_bound(b, c, *a1, less);
+      const auto b2 =
+        piece + 1 == npieces ? c : std::lower_bound(b, c, *a2, less);
+      std::merge(a1, a2, b1, b2, other.begin() + (a1 - v.begin()) + (b1 - b),
+                 less);
+    });
+    v.swap(other);
+  }
+}
+
+/**
+ * sorts list by sorting a compact array of keys and positions, then moving
+ * each file into place once. Fileinfo is large, so this is much cheaper
+ * than sorting the list itself, which moves files around many times.
+ * keyof(file) gives the key. compare(keya, a, keyb, b) compares two keys
+ * like strcmp, a and b are the positions in list so it may look at the
+ * files to break ties. remaining ties keep their order, so the sort is
+ * stable.
+ */
+template<class Keyof, class Compare>
+void
+sortwithkeys(Filelist& list, Keyof keyof, Compare compare, unsigned nthreads)
+{
+  using Key = decltype(keyof(list.front()));
+  struct Entry
+  {
+    Key key;
+    std::size_t index;
+  };
+  const std::size_t n = list.size();
+  std::vector<Entry, Mapallocator<Entry>> entries(n);
+  const std::size_t nblocks = (n + minperthread - 1) / minperthread;
+  parallelfor(nblocks, threadsfor(n, nthreads), [&](std::size_t block) {
+    const std::size_t last = std::min(n, (block + 1) * minperthread);
+    for (std::size_t i = block * minperthread; i < last; ++i) {
+      entries[i] = Entry{ keyof(list[i]), i };
+    }
+  });
+  sortinruns(
+    entries,
+    [&](const Entry& a, const Entry& b) {
+      const int c = compare(a.key, a.index, b.key, b.index);
+      return c < 0 || (c == 0 && a.index < b.index);
+    },
+    nthreads);
+
+  // the file at position order[i] goes to position i. follow each cycle
+  // of the permutation, so every file is moved once.
+  std::vector<std::size_t, Mapallocator<std::size_t>> order(entries.size());
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    order[i] = entries[i].index;
+  }
+  decltype(entries)().swap(entries);
+  for (std::size_t i = 0; i < order.size(); ++i) {
+    if (order[i] == i) {
+      continue;
+    }
+    Fileinfo tmp(std::move(list[i]));
+    std::size_t j = i;
+    while (order[j] != i) {
+      const std::size_t from = order[j];
+      list[j] = std::move(list[from]);
+      order[j] = j;
+      j = from;
+    }
+    list[j] = std::move(tmp);
+    order[j] = j;
+  }
+}
+
+// three way comparison of two values
+template<class T>
+int
+threeway(const T& a, const T& b)
+{
+  return a < b ? -1 : (b < a ? 1 : 0);
+}
+
+using Indexvector = std::vector<std::size_t, Mapallocator<std::size_t>>;
+
+/**
+ * finds the groups of equal elements among element(0)..element(n-1), which
+ * are positions in groups. hash(e) is the hash of element e, and equal(e, f)
+ * tells if elements e and f are equal. the first element of each group is
+ * kept in an open addressing table, at most half full, so each element is
+ * compared with few others. the groups are numbered from zero in the order
+ * they are first seen, groups[e] is set to the group of element e. returns
+ * the number of groups.
+ */
+template<class Element, class Hash, class Equal>
+std::size_t
+groupsome(std::size_t n,
+          Element element,
+          Hash hash,
+          Equal equal,
+          Indexvector& groups)
+{
+  std::size_t nslots = 16;
+  while (nslots < 2 * n) {
+    nslots *= 2;
+  }
+  const std::size_t mask = nslots - 1;
+
+  // the element of the first in a group plus one, zero for empty slots
+  Indexvector slots(nslots);
+  std::size_t ngroups = 0;
+  for (std::size_t k = 0; k < n; ++k) {
+    const std::size_t e = element(k);
+    for (std::size_t s = hash(e) & mask;; s = (s + 1) & mask) {
+      if (slots[s] == 0) {
+        slots[s] = e + 1;
+        groups[e] = ngroups++;
+        break;
+      }
+      if (equal(slots[s] - 1, e)) {
+        groups[e] = groups[slots[s] - 1];
+        break;
+      }
+    }
+  }
+  return ngroups;
+}
+
+/**
+ * finds the groups of equal elements among 0..n-1 without sorting, in time
+ * linear in n, see groupsome. with more than one thread, the elements are
+ * split into partitions on the top bits of their hash, so equal elements
+ * end up in the same partition, and the partitions are grouped
+ * concurrently. the numbering of the groups then depends on nthreads, but
+ * which elements are grouped together does not.
+ */
+template<class Hash, class Equal>
+std::size_t
+groupby(std::size_t n,
+        Hash hash,
+        Equal equal,
+        Indexvector& groups,
+        unsigned nthreads)
+{
+  groups.resize(n);
+  nthreads = threadsfor(n, nthreads);
+  if (nthreads <= 1) {
+    return groupsome(
+      n, [](std::size_t k) { return k; }, hash, equal, groups);
+  }
+
+  // a few partitions per thread, so they are shared out evenly
+  unsigned bits = 1;
+  while ((1U << bits) < 4 * nthreads) {
+    ++bits;
+  }
+  const std::size_t npartitions = std::size_t{ 1 } << bits;
+  const auto partitionof = [bits](std::uint64_t h) { return h >> (64 - bits); };
+
+  // hash the elements block by block, counting how many of each block go
+  // to each partition
+  const std::size_t nblocks = (n + minperthread - 1) / minperthread;
+  std::vector<std::uint64_t, Mapallocator<std::uint64_t>> hashes(n);
+  Indexvector positions(nblocks * npartitions);
+  parallelfor(nblocks, nthreads, [&](std::size_t block) {
+    const std::size_t last = std::min(n, (block + 1) * minperthread);
+    for (std::size_t i = block * minperthread; i < last; ++i) {
+      hashes[i] = hash(i);
+      ++positions[block * npartitions + partitionof(hashes[i])];
+    }
+  });
+
+  // where each block puts its elements of each partition, so the elements
+  // of a partition are kept in order
+  Indexvector partitions(npartitions + 1);
+  std::size_t position = 0;
+  for (std::size_t p = 0; p < npartitions; ++p) {
+    partitions[p] = position;
+    for (std::size_t block = 0; block < nblocks; ++block) {
+      const std::size_t count = positions[block * npartitions + p];
+      positions[block * npartitions + p] = position;
+      position += count;
+    }
+  }
+  partitions[npartitions] = n;
+  Indexvector order(n);
+  parallelfor(nblocks, nthreads, [&](std::size_t block) {
+    const std::size_t last = std::min(n, (block + 1) * minperthread);
+    for (std::size_t i = block * minperthread; i < last; ++i) {
+      order[positions[block * npartitions + partitionof(hashes[i])]++] = i;
+    }
+  });
+  decltype(positions)().swap(positions);
+
+  // group each partition, then number the groups of the partitions after
+  // each other
+  Indexvector ngroups(npartitions);
+  parallelfor(npartitions, nthreads, [&](std::size_t p) {
+    ngroups[p] = groupsome(
+      partitions[p + 1] - partitions[p],
+      [&](std::size_t k) { return order[partitions[p] + k]; },
+      [&](std::size_t e) { return hashes[e]; },
+      equal,
+      groups);
+  });
+  std::size_t total = 0;
+  for (auto& g : ngroups) {
+    const std::size_t first = total;
+    total += g;
+    g = first;
+  }
+  parallelfor(npartitions, nthreads, [&](std::size_t p) {
+    for (std::size_t k = partitions[p]; k < partitions[p + 1]; ++k) {
+      groups[order[k]] += ngroups[p];
+    }
+  });
+  return total;
+}
+
+// the number of elements in each group found by groupby
+Indexvector
+groupsizes(const Indexvector& groups, std::size_t ngroups)
+{
+  Indexvector counts(ngroups);
+  for (const auto g : groups) {
+    ++counts[g];
+  }
+  return counts;
+}
+
 // compares rank as described in RANKING on man page.
 bool
 cmpRank(const Fileinfo& a, const Fileinfo& b)
@@ -201,13 +608,6 @@ cmpRank(const Fileinfo& a, const Fileinfo& b)
   return std::make_tuple(a.get_cmdline_index(), a.depth(), a.getidentity()) <
          std::make_tuple(b.get_cmdline_index(), b.depth(), b.getidentity());
 }
-bool
-cmpDepthName(const Fileinfo& a, const Fileinfo& b)
-{
-  // inefficient, make it a reference.
-  return std::make_tuple(a.depth(), a.name()) <
-         std::make_tuple(b.depth(), b.name());
-}
 // compares buffers
 bool
 cmpBuffers(const Fileinfo& a, const Fileinfo& b)
@@ -223,12 +623,6 @@ hasEqualBuffers(const Fileinfo& a, const Fileinfo& b)
 }
 #endif
 
-// compares file size
-bool
-cmpSize(const Fileinfo& a, const Fileinfo& b)
-{
-  return a.size() < b.size();
-}
 bool
 cmpSizeThenBuffer(const Fileinfo& a, const Fileinfo& b)
 {
@@ -282,103 +676,305 @@ apply_on_range(Iterator first, Iterator last, Cmp cmp, Callback callback)
   }
 }
 } // namespace
-int
-Rdutil::sortOnDeviceAndInode()
+void
+Rdutil::sort_on_cmdline_index(bool deterministic)
 {
+  if (!deterministic) {
+    if (std::is_sorted(m_list.begin(),
+                       m_list.end(),
+                       [](const Fileinfo& a, const Fileinfo& b) {
+                         return a.get_cmdline_index() < b.get_cmdline_index();
+                       })) {
+      return;
+    }
+    sortwithkeys(
+      m_list,
+      [](const Fileinfo& f) { return f.get_cmdline_index(); },
+      [](int a, std::size_t, int b, std::size_t) { return threeway(a, b); },
+      m_nthreads);
+    return;
+  }
 
-  std::sort(m_list.begin(), m_list.end(), cmpDeviceInode);
-  return 0;
+  // files in different directories are ordered as their directories, which
+  // is the order of the paths unless one directory is below the other. the
+  // paths are only compared for those. within a directory, the names are
+  // only compared if they start with the same eight bytes.
+  const auto order = Fileinfo::paths().sortorder();
+  struct Key
+  {
+    int cmdline_index;
+    int depth;
+    Pathtable::Order dir;
+    std::uint64_t nameprefix;
+  };
+  const auto keyof = [&order](const Fileinfo& f) {
+    return Key{
+      f.get_cmdline_index(), f.depth(), order[f.directory()], f.nameprefix()
+    };
+  };
+  const auto compare =
+    [this](const Key& a, std::size_t ia, const Key& b, std::size_t ib) {
+      const int c = threeway(std::make_pair(a.cmdline_index, a.depth),
+                             std::make_pair(b.cmdline_index, b.depth));
+      if (c != 0) {
+        return c;
+      }
+      const bool below =
+        (a.dir.first < b.dir.first && b.dir.first <= a.dir.last) ||
+        (b.dir.first < a.dir.first && a.dir.first <= b.dir.last);
+      if (a.dir.first != b.dir.first && !below) {
+        return threeway(a.dir.first, b.dir.first);
+      }
+      if (a.dir.first == b.dir.first && a.nameprefix != b.nameprefix) {
+        return threeway(a.nameprefix, b.nameprefix);
+      }
+      return Fileinfo::comparenames(m_list[ia], m_list[ib]);
+    };
+
+  // lists given in order need no sorting
+  bool sorted = true;
+  for (std::size_t i = 1; sorted && i < m_list.size(); ++i) {
+    sorted = compare(keyof(m_list[i - 1]), i - 1, keyof(m_list[i]), i) <= 0;
+  }
+  if (!sorted) {
+    sortwithkeys(m_list, keyof, compare, m_nthreads);
+  }
 }
 
 void
-Rdutil::sort_on_depth_and_name(std::size_t index_of_first)
+Rdutil::sortOnSizeAndBuffer()
 {
-  assert(index_of_first <= m_list.size());
-
-  auto it = std::begin(m_list) + static_cast<std::ptrdiff_t>(index_of_first);
-  std::sort(it, std::end(m_list), cmpDepthName);
+  // the buffers are only compared between files of equal size
+  sortwithkeys(
+    m_list,
+    [](const Fileinfo& f) { return f.size(); },
+    [this](Fileinfo::filesizetype a,
+           std::size_t ia,
+           Fileinfo::filesizetype b,
+           std::size_t ib) {
+      if (a != b) {
+        return threeway(a, b);
+      }
+      return std::memcmp(m_list[ia].getbyteptr(),
+                         m_list[ib].getbyteptr(),
+                         m_list[ia].getbuffersize());
+    },
+    m_nthreads);
 }
 
 std::size_t
 Rdutil::removeIdenticalInodes()
 {
-  // sort list on device and inode.
-  auto cmp = cmpDeviceInode;
-  std::sort(m_list.begin(), m_list.end(), cmp);
+  // group on device and inode
+  Indexvector groups;
+  const std::size_t ngroups = groupby(
+    m_list.size(),
+    [this](std::size_t i) {
+      return mixbits(mixbits(m_list[i].device()) ^ m_list[i].inode());
+    },
+    [this](std::size_t i, std::size_t j) {
+      return m_list[i].inode() == m_list[j].inode() &&
+             m_list[i].device() == m_list[j].device();
+    },
+    groups,
+    m_nthreads);
 
-  // loop over ranges of adjacent elements
-  using Iterator = decltype(m_list.begin());
-  apply_on_range(
-    m_list.begin(), m_list.end(), cmp, [](Iterator first, Iterator last) {
-      // let the highest-ranking element not be deleted. do this in order, to be
-      // cache friendly.
-      auto best = std::min_element(first, last, cmpRank);
-      std::for_each(first, best, [](Fileinfo& f) { f.setdeleteflag(true); });
-      best->setdeleteflag(false);
-      std::for_each(best + 1, last, [](Fileinfo& f) { f.setdeleteflag(true); });
-    });
+  // let the highest-ranking element of each group not be deleted.
+  const std::size_t none = m_list.size();
+  Indexvector best(ngroups, none);
+  for (std::size_t i = 0; i < m_list.size(); ++i) {
+    auto& b = best[groups[i]];
+    if (b == none || cmpRank(m_list[i], m_list[b])) {
+      b = i;
+    }
+  }
+  for (std::size_t i = 0; i < m_list.size(); ++i) {
+    m_list[i].setdeleteflag(best[groups[i]] != i);
+  }
   return cleanup();
 }
 
+void
+Rdutil::addfile(Fileinfo file)
+{
+  const auto size = file.size();
+  const auto found = m_sizeindex.find(size);
+  if (found == m_sizeindex.end()) {
+    m_sizeindex.emplace(size, Sizeentry{ file.compact(), false });
+    ++m_nuniquesizes;
+    m_uniquesizesbytes += size;
+    return;
+  }
+  if (!found->second.inlist) {
+    // the size is no longer unique, the first file goes in the list.
+    m_list.emplace_back(found->second.first, size);
+    found->second.inlist = true;
+    --m_nuniquesizes;
+    m_uniquesizesbytes -= size;
+  }
+  m_list.emplace_back(std::move(file));
+}
+
+std::size_t
+Rdutil::endcount()
+{
+  sortinruns(m_sizes, std::less<Fileinfo::filesizetype>(), m_nthreads);
+  // keep one of each size found more than once
+  std::size_t nshared = 0;
+  std::size_t nkept = 0;
+  for (std::size_t first = 0; first != m_sizes.size();) {
+    std::size_t last = first + 1;
+    while (last != m_sizes.size() && m_sizes[last] == m_sizes[first]) {
+      ++last;
+    }
+    if (last - first > 1) {
+      m_sizes[nkept++] = m_sizes[first];
+      nshared += last - first;
+    }
+    first = last;
+  }
+  m_sizes.resize(nkept);
+  m_sizes.shrink_to_fit();
+  m_sizefilter = true;
+  return nshared;
+}
+
 std::size_t
 Rdutil::removeUniqueSizes()
 {
-  // sort list on size
-  auto cmp = cmpSize;
-  std::sort(m_list.begin(), m_list.end(), cmp);
+  // the files still only in the index have a unique size, drop them.
+  const std::size_t nheld = m_nuniquesizes;
+  m_sizeindex.clear();
+  m_nuniquesizes = 0;
+  m_uniquesizesbytes = 0;
 
-  // loop over ranges of adjacent elements
-  using Iterator = decltype(m_list.begin());
-  apply_on_range(
-    m_list.begin(), m_list.end(), cmp, [](Iterator first, Iterator last) {
-      if (first + 1 == last) {
-        // single element. remove it!
-        first->setdeleteflag(true);
-      } else {
-        // multiple elements. keep them!
-        std::for_each(first, last, [](Fileinfo& f) { f.setdeleteflag(false); });
-      }
-    });
-  return cleanup();
+  // sizes in the list can have become unique, since removing identical
+  // inodes. count each size, without sorting.
+  Indexvector groups;
+  const std::size_t ngroups = groupby(
+    m_list.size(),
+    [this](std::size_t i) {
+      return mixbits(static_cast<std::uint64_t>(m_list[i].size()));
+    },
+    [this](std::size_t i, std::size_t j) {
+      return m_list[i].size() == m_list[j].size();
+    },
+    groups,
+    m_nthreads);
+  const auto counts = groupsizes(groups, ngroups);
+  for (std::size_t i = 0; i < m_list.size(); ++i) {
+    m_list[i].setdeleteflag(counts[groups[i]] == 1);
+  }
+  return nheld + cleanup();
 }
 
 std::size_t
-Rdutil::removeUniqSizeAndBuffer()
+Rdutil::removeUniqContent(const long nsecsleep, const unsigned readthreads)
 {
-  // sort list on size
-  const auto cmp = cmpSize;
-  std::sort(m_list.begin(), m_list.end(), cmp);
+  // the groups of equal size and buffer, which are compared unless the
+  // buffer holds all of the file. a group is on one device, or on several
+  // if mixed is set.
+  sortOnSizeAndBuffer();
+  struct Range
+  {
+    std::size_t first;
+    std::size_t last;
+    unsigned long device;
+    bool mixed;
+  };
+  std::vector<Range> ranges;
+  for (std::size_t first = 0; first != m_list.size();) {
+    std::size_t last = first + 1;
+    const unsigned long device = m_list[first].device();
+    bool mixed = false;
+    while (last != m_list.size() &&
+           !cmpSizeThenBuffer(m_list[first], m_list[last])) {
+      mixed = mixed || m_list[last].device() != device;
+      ++last;
+    }
+    if (static_cast<Fileinfo::filesizetype>(m_list[first].getbuffersize()) <
+        m_list[first].size()) {
+      ranges.push_back(Range{ first, last, device, mixed });
+    }
+    first = last;
+  }
 
-  const auto bufcmp = cmpBuffers;
+  // each compared file gets the position of the first file with the same
+  // content plus one, or zero if there is none
+  Indexvector same(m_list.size(), 0);
+  std::vector<bool> compared(m_list.size(), false);
+  for (const auto& range : ranges) {
+    std::fill(compared.begin() + static_cast<std::ptrdiff_t>(range.first),
+              compared.begin() + static_cast<std::ptrdiff_t>(range.last),
+              true);
+  }
+  const Lockstep lockstep(nsecsleep);
+  const auto compare = [&](const Range& range) {
+    std::vector<std::string> names;
+    for (std::size_t i = range.first; i != range.last; ++i) {
+      names.push_back(m_list[i].name());
+    }
+    const auto firsts = lockstep.compare(names, m_list[range.first].size());
+    for (std::size_t i = range.first; i != range.last; ++i) {
+      const std::size_t first = firsts[i - range.first];
+      same[i] = first == Lockstep::unique ? 0 : range.first + first + 1;
+    }
+  };
 
-  // loop over ranges of adjacent elements
-  using Iterator = decltype(m_list.begin());
-  apply_on_range(
-    m_list.begin(), m_list.end(), cmp, [&](Iterator first, Iterator last) {
-      // all sizes are equal in [first,last) - sort on buffer content.
-      std::sort(first, last, bufcmp);
-
-      // on this set of buffers, find those which are unique
-      apply_on_range(
-        first, last, bufcmp, [](Iterator firstbuf, Iterator lastbuf) {
-          if (firstbuf + 1 == lastbuf) {
-            // we have a unique buffer!
-            firstbuf->setdeleteflag(true);
-          } else {
-            std::for_each(
-              firstbuf, lastbuf, [](Fileinfo& f) { f.setdeleteflag(false); });
-          }
-        });
+  // a group is compared by one thread. groups on several devices are
+  // compared one at a time, the others are compared concurrently by the
+  // threads of their device, as in eliminatebysize.
+  std::vector<Range> single;
+  for (const auto& range : ranges) {
+    if (range.mixed) {
+      compare(range);
+    } else {
+      single.push_back(range);
+    }
+  }
+  std::stable_sort(
+    single.begin(), single.end(), [](const Range& a, const Range& b) {
+      return a.device < b.device;
     });
+  readbydevice(
+    single.size(),
+    [&single](std::size_t r) { return single[r].device; },
+    Devicethreads(m_list, readthreads),
+    [&](std::size_t r) { compare(single[r]); });
 
+  // the buffer of a compared file is replaced by that number, so files
+  // with equal buffers are identical. the others keep their bytes.
+  std::size_t tablesize = 0;
+  for (std::size_t i = 0; i < m_list.size(); ++i) {
+    tablesize +=
+      compared[i] ? sizeof(std::uint64_t) : m_list[i].getbuffersize();
+  }
+  decltype(m_bytes) table(tablesize);
+  std::size_t offset = 0;
+  for (std::size_t i = 0; i < m_list.size(); ++i) {
+    Fileinfo& elem = m_list[i];
+    if (compared[i]) {
+      char* p = table.data() + offset;
+      for (std::size_t k = 0; k < sizeof(std::uint64_t); ++k) {
+        p[k] = static_cast<char>((same[i] >> (8 * (7 - k))) & 0xFF);
+      }
+      elem.setbuffer(p, sizeof(std::uint64_t), false);
+      elem.setdeleteflag(same[i] == 0);
+    } else {
+      elem.setbuffer(table.data() + offset, elem.getbuffersize(), true);
+    }
+    offset += elem.getbuffersize();
+  }
+  m_bytes.swap(table);
   return cleanup();
 }
 
 void
 Rdutil::markduplicates()
 {
+  // only the duplicates are left, sort them so each set is together.
+  sortOnSizeAndBuffer();
   const auto cmp = cmpSizeThenBuffer;
-  assert(std::is_sorted(m_list.begin(), m_list.end(), cmp));
 
   // loop over ranges of adjacent elements
   using Iterator = decltype(m_list.begin());
@@ -460,6 +1056,7 @@ Rdutil::totalsizeinbytes(int opmode) const
 
   Fileinfo::filesizetype totalsize = 0;
   if (opmode == 0) {
+    totalsize = m_uniquesizesbytes;
     for (const auto& elem : m_list) {
       totalsize += elem.size();
     }
@@ -538,21 +1135,196 @@ Rdutil::saveablespace(std::ostream& out) const
   return out;
 }
 
-int
-Rdutil::fillwithbytes(enum Fileinfo::readtobuffermode type,
-                      enum Fileinfo::readtobuffermode lasttype,
-                      const long nsecsleep)
+std::vector<std::size_t>
+Rdutil::eliminatebysize(const std::vector<Stage>& stages,
+                        const long nsecsleep,
+                        const unsigned readthreads)
 {
-  // first sort on inode (to read efficiently from the hard drive)
-  sortOnDeviceAndInode();
+  std::vector<std::atomic<std::size_t>> removed(stages.size());
+  for (auto& r : removed) {
+    r = 0;
+  }
+  if (stages.empty()) {
+    return std::vector<std::size_t>(stages.size());
+  }
+
+  // the groups of equal size, with the files of each in device and inode
+  // order to read efficiently
+  sortwithkeys(
+    m_list,
+    [](const Fileinfo& f) {
+      return std::make_tuple(f.size(), f.device(), f.inode());
+    },
+    [](const std::tuple<Fileinfo::filesizetype, unsigned long, unsigned long>&
+         a,
+       std::size_t,
+       const std::tuple<Fileinfo::filesizetype, unsigned long, unsigned long>&
+         b,
+       std::size_t) { return threeway(a, b); },
+    m_nthreads);
+
+  // the buffers of the last stage go in a table with room for all files,
+  // each group has its part. the earlier stages use a buffer of the group,
+  // with room for the largest stage.
+  const std::size_t finalsize = Fileinfo::buffersize(stages.back().mode);
+  std::size_t maxsize = 0;
+  for (const auto& stage : stages) {
+    maxsize = std::max(maxsize, Fileinfo::buffersize(stage.mode));
+  }
+  // a group is on one device, or on several if mixed is set
+  struct Group
+  {
+    std::size_t first;
+    std::size_t last;
+    std::size_t offset;
+    unsigned long device;
+    bool mixed;
+  };
+  std::vector<Group> groups;
+  std::size_t tablesize = 0;
+  for (std::size_t first = 0; first != m_list.size();) {
+    std::size_t last = first + 1;
+    while (last != m_list.size() &&
+           m_list[last].size() == m_list[first].size()) {
+      ++last;
+    }
+    const unsigned long device = m_list[first].device();
+    groups.push_back(Group{
+      first, last, tablesize, device, m_list[last - 1].device() != device });
+    tablesize += (last - first) * m_list[first].buffersize(finalsize);
+    first = last;
+  }
+  decltype(m_bytes) table(tablesize);
+
+  const Devicethreads threadsof(m_list, readthreads);
+  const auto& devicethreads = threadsof.devices;
 
   const auto duration = std::chrono::nanoseconds{ nsecsleep };
+  // runs the stages on a group. if spread is set, its files are read by
+  // the threads of their devices, otherwise by the calling thread.
+  const auto eliminate = [&](const Group& group, bool spread) {
+    const std::size_t n = group.last - group.first;
+    const auto at = [&](std::size_t i) -> Fileinfo& {
+      return m_list[group.first + i];
+    };
+    std::vector<char> buffers(n * maxsize);
+    const auto bufferof = [&](std::size_t i) {
+      return buffers.data() + i * maxsize;
+    };
+
+    // the positions in the group of the files left, in reading order
+    std::vector<std::size_t> left(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      left[i] = i;
+      at(i).setbuffer(bufferof(i), 0, false);
+    }
+    std::vector<std::size_t> order;
+    for (std::size_t s = 0; s < stages.size() && !left.empty(); ++s) {
+      const auto lasttype =
+        s ? stages[s - 1].mode : Fileinfo::readtobuffermode::NOT_DEFINED;
+      const Fileinfo::filesizetype lastlength = s ? stages[s - 1].length : 0;
+      const std::size_t stagesize = Fileinfo::buffersize(stages[s].mode);
+      const auto read = [&](std::size_t k) {
+        Fileinfo& f = at(left[k]);
+        // the buffer stays in place, so what is kept is still there
+        f.setbuffer(bufferof(left[k]), f.buffersize(stagesize), false);
+        // a file which could not be read, or has changed since it was
+        // found, is dropped
+        f.setdeleteflag(f.fillwithbytes(stages[s].mode,
+                                        lasttype,
+                                        stages[s].length,
+                                        lastlength) != 0);
+        if (nsecsleep > 0) {
+          std::this_thread::sleep_for(duration);
+        }
+      };
+      if (spread) {
+        readbydevice(
+          left.size(),
+          [&](std::size_t k) { return at(left[k]).device(); },
+          std::cref(threadsof),
+          read);
+      } else {
+        for (std::size_t k = 0; k < left.size(); ++k) {
+          read(k);
+        }
+      }
+
+      // remove the dropped files, and those with a buffer no other file has
+      std::size_t nremoved = 0;
+      order.clear();
+      for (const auto i : left) {
+        if (at(i).deleteflag()) {
+          at(i).setbuffer(nullptr, 0, false);
+          ++nremoved;
+        } else {
+          order.push_back(i);
+        }
+      }
+      const auto less = [&](std::size_t a, std::size_t b) {
+        return cmpBuffers(at(a), at(b));
+      };
+      std::stable_sort(order.begin(), order.end(), less);
+      for (auto first = order.begin(); first != order.end();) {
+        auto last = first + 1;
+        while (last != order.end() && !less(*first, *last)) {
+          ++last;
+        }
+        if (last - first == 1) {
+          at(*first).setdeleteflag(true);
+          at(*first).setbuffer(nullptr, 0, false);
+          ++nremoved;
+        }
+        first = last;
+      }
+      left.erase(
+        std::remove_if(left.begin(),
+                       left.end(),
+                       [&](std::size_t i) { return at(i).deleteflag(); }),
+        left.end());
+      removed[s] += nremoved;
+    }
 
-  for (auto& elem : m_list) {
-    elem.fillwithbytes(type, lasttype);
-    if (nsecsleep > 0) {
-      std::this_thread::sleep_for(duration);
+    // move what is left to the table
+    const std::size_t width = at(0).buffersize(finalsize);
+    for (const auto i : left) {
+      at(i).setbuffer(table.data() + group.offset + i * width, width, true);
+    }
+  };
+
+  // large groups, and groups on several devices, are done one at a time
+  // with their files read by the threads of their devices. the other groups
+  // are split by device, and the groups of each device are done
+  // concurrently by the threads of that device.
+  std::vector<std::vector<Group>> bydevice(devicethreads.size());
+  for (const auto& group : groups) {
+    if (group.mixed || group.last - group.first >= largegroup) {
+      eliminate(group, true);
+      continue;
+    }
+    for (std::size_t d = 0; d < devicethreads.size(); ++d) {
+      if (devicethreads[d].first == group.device) {
+        bydevice[d].push_back(group);
+      }
     }
   }
-  return 0;
+  const auto readdevice = [&](std::size_t d) {
+    parallelfor(bydevice[d].size(),
+                devicethreads[d].second,
+                [&](std::size_t g) { eliminate(bydevice[d][g], false); });
+  };
+  std::vector<std::thread> threads;
+  for (std::size_t d = 1; d < bydevice.size(); ++d) {
+    threads.emplace_back(readdevice, d);
+  }
+  if (!bydevice.empty()) {
+    readdevice(0);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  m_bytes.swap(table);
+  cleanup();
+  return std::vector<std::size_t>(removed.begin(), removed.end());
 }
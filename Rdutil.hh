@@ -9,17 +9,72 @@
 #ifndef rdutil_hh
 #define rdutil_hh
 
+#include <algorithm>
+#include <unordered_map>
 #include <vector>
 
 #include "Fileinfo.hh" //file container
+#include "Mapstore.hh" //storage for large arrays
+
+/// the list of all files
+using Filelist = std::vector<Fileinfo, Mapallocator<Fileinfo>>;
 
 class Rdutil
 {
 public:
-  explicit Rdutil(std::vector<Fileinfo>& list)
+  explicit Rdutil(Filelist& list)
     : m_list(list)
+    , m_nuniquesizes(0)
+    , m_uniquesizesbytes(0)
+    , m_sizefilter(false)
+    , m_nthreads(1)
   {}
 
+  /// sets the number of threads used to sort and group the list. the
+  /// results do not depend on it. zero is treated as one.
+  void setnthreads(unsigned nthreads) { m_nthreads = nthreads ? nthreads : 1; }
+
+  /**
+   * adds a regular file found during traversal. a file with a size no
+   * other file has so far is kept compactly outside the list, and is only
+   * put in the list once a second file of that size is added. not thread
+   * safe.
+   */
+  void addfile(Fileinfo file);
+
+  /// counts a file of the given size in the first pass of a two pass scan.
+  /// the file is not kept. not thread safe.
+  void countsize(Fileinfo::filesizetype size) { m_sizes.push_back(size); }
+
+  /// the number of files counted by countsize
+  std::size_t ncounted() const { return m_sizes.size(); }
+
+  /**
+   * ends the first pass of a two pass scan. from now on, sizeshared is only
+   * true for sizes counted more than once. returns the number of files
+   * counted with such a size.
+   */
+  std::size_t endcount();
+
+  /// false if size was found only once in the first pass of a two pass
+  /// scan. a file with such a size can not have a duplicate. thread safe.
+  bool sizeshared(Fileinfo::filesizetype size) const
+  {
+    return !m_sizefilter ||
+           std::binary_search(m_sizes.begin(), m_sizes.end(), size);
+  }
+
+  /// counts a file that is not added since its size is not shared. not
+  /// thread safe.
+  void skipfile(Fileinfo::filesizetype size)
+  {
+    ++m_nuniquesizes;
+    m_uniquesizesbytes += size;
+  }
+
+  /// the number of files, including those held outside the list by addfile
+  std::size_t nfiles() const { return m_list.size() + m_nuniquesizes; }
+
   /**
    * print file names to a file, with extra information.
    * @param filename
@@ -31,40 +86,50 @@ public:
   void markitems();
 
   /**
-   * sorts the list on device and inode. not guaranteed to be stable.
-   * @return
+   * sorts on command line index. within a command line index, the order
+   * is kept, or if deterministic is set, sorted on depth then name. the
+   * latter is useful to be independent of the filesystem order. either way,
+   * the result does not depend on which starting point was traversed first.
    */
-  int sortOnDeviceAndInode();
+  void sort_on_cmdline_index(bool deterministic);
 
   /**
-   * sorts from the given index to the end on depth, then name.
-   * this is useful to be independent of the filesystem order.
+   * sorts the list on size, then on the bytes read by eliminatebysize.
+   * stable.
    */
-  void sort_on_depth_and_name(std::size_t index_of_first);
+  void sortOnSizeAndBuffer();
 
   /**
    * for each group of identical inodes, only keep the one with the highest
-   * rank.
+   * rank. the groups are found by hashing, the order of the list is kept.
    * @return number of elements removed
    */
   std::size_t removeIdenticalInodes();
 
   /**
-   * remove files with unique size from the list.
-   * @return
+   * remove files with unique size from the list, including those held
+   * outside the list by addfile.
+   * @return the number of removed files
    */
   std::size_t removeUniqueSizes();
 
   /**
-   * remove files with unique combination of size and buffer from the list.
-   * @return
+   * compares the contents of files with equal size and buffer with
+   * Lockstep, and removes those that are not identical to another file.
+   * the buffer of each compared file is then replaced by a number which is
+   * equal for identical files, so markduplicates can be used as after the
+   * checksums. nsecsleep is passed on to Lockstep. each group is compared by
+   * one thread, and the groups on one device are compared concurrently by
+   * readthreads threads for that device (one on rotating disks), as in
+   * eliminatebysize. groups on several devices are compared one at a time.
+   * @return the number of removed files
    */
-  std::size_t removeUniqSizeAndBuffer();
+  std::size_t removeUniqContent(long nsecsleep = 0, unsigned readthreads = 1);
 
   /**
-   * Assumes the list is already sorted on size, and all elements with the same
-   * size have the same buffer. Marks duplicates with tags, depending on their
-   * nature. Shall be used when everything is done, and sorted.
+   * Assumes all elements with the same size have the same buffer. Sorts the
+   * list on size and buffer, and marks duplicates with tags, depending on
+   * their nature. Shall be used when everything is done.
    * For each sequence of duplicates, the original will be placed first but no
    * other guarantee on ordering is given.
    *
@@ -80,16 +145,33 @@ public:
    */
   std::size_t remove_small_files(Fileinfo::filesizetype minsize);
 
-  // read some bytes. note! destroys the order of the list.
-  // if lasttype is supplied, it does not reread files if they are shorter
-  // than the file length. (unnecessary!). if -1, feature is turned off.
-  // and file is read anyway.
-  // if there is trouble with too much disk reading, sleeping for nsecsleep
-  // nanoseconds can be made between each file.
-  int fillwithbytes(enum Fileinfo::readtobuffermode type,
-                    enum Fileinfo::readtobuffermode lasttype =
-                      Fileinfo::readtobuffermode::NOT_DEFINED,
-                    long nsecsleep = 0);
+  /// a stage of elimination on the contents of the files. length is passed
+  /// on to Fileinfo::fillwithbytes.
+  struct Stage
+  {
+    Fileinfo::readtobuffermode mode;
+    Fileinfo::filesizetype length;
+  };
+
+  /**
+   * takes each group of files of equal size through all the stages on its
+   * own. at each stage, the files of the group are read in device and inode
+   * order with Fileinfo::fillwithbytes, and those which can not be read,
+   * have changed size since they were found, or have a buffer no other file
+   * of the group has, are removed. only the buffers of the groups being read
+   * are held until the last stage, whose buffers are kept for
+   * sortOnSizeAndBuffer and markduplicates. if there is trouble with too
+   * much disk reading, nsecsleep nanoseconds are slept after each file.
+   * each device is read by readthreads threads (one on rotating disks): the
+   * groups on one device are done concurrently by the threads of that
+   * device, and the devices concurrently. large groups, and groups on
+   * several devices, are done one at a time with their files read by the
+   * threads of their devices.
+   * @return the number of files removed at each stage
+   */
+  std::vector<std::size_t> eliminatebysize(const std::vector<Stage>& stages,
+                                           long nsecsleep = 0,
+                                           unsigned readthreads = 1);
 
   /// make symlinks of duplicates.
   std::size_t makesymlinks(bool dryrun) const;
@@ -102,7 +184,8 @@ public:
 
   /**
    * gets the total size, in bytes.
-   * @param opmode 0 just add everything, 1 only elements with
+   * @param opmode 0 just add everything (including files held outside the
+   * list by addfile), 1 only elements with
    * m_duptype=Fileinfo::DUPTYPE_FIRST_OCCURRENCE
    * @return
    */
@@ -121,7 +204,33 @@ public:
   std::ostream& saveablespace(std::ostream& out) const;
 
 private:
-  std::vector<Fileinfo>& m_list;
+  Filelist& m_list;
+
+  // the files added by addfile, by size. a size seen once holds that file,
+  // later ones are in m_list.
+  struct Sizeentry
+  {
+    Fileinfo::Compact first;
+    bool inlist;
+  };
+  std::unordered_map<Fileinfo::filesizetype, Sizeentry> m_sizeindex;
+
+  // the number and total size of files only held in m_sizeindex
+  std::size_t m_nuniquesizes;
+  Fileinfo::filesizetype m_uniquesizesbytes;
+
+  // the sizes counted by countsize, and after endcount the sorted sizes
+  // counted more than once, which sizeshared checks if m_sizefilter is set
+  std::vector<Fileinfo::filesizetype, Mapallocator<Fileinfo::filesizetype>>
+    m_sizes;
+  bool m_sizefilter;
+
+  // the buffers of the files in the list, filled by eliminatebysize. it is
+  // replaced by removeUniqContent, sized for what that stores.
+  std::vector<char, Mapallocator<char>> m_bytes;
+
+  // the number of threads to sort and group with
+  unsigned m_nthreads;
 };
 
 #endif
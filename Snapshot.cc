@@ -0,0 +1,244 @@
+/*
+   copyright 2026 Paul Dreik
+   Distributed under GPL v 2.0 or later, at your option.
+   See LICENSE for further details.
+*/
+
+#include "config.h"
+
+// std
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+
+// project
+#include "Snapshot.hh"
+
+namespace {
+// identifies the file format, change it if the format changes
+const char magic[] = "rdfind snapshot 2\n";
+
+// the integers in the file are stored as they are in memory
+template<class T>
+void
+appendint(std::string& out, T value)
+{
+  out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template<class T>
+T
+readint(const char*& p)
+{
+  T value;
+  std::memcpy(&value, p, sizeof(value));
+  p += sizeof(value);
+  return value;
+}
+} // namespace
+
+Snapshot::Snapshot()
+  : m_started(std::time(nullptr))
+  , m_nreused(0)
+  , m_nread(0)
+{}
+
+Snapshot::Key
+Snapshot::keyof(const struct stat& dirinfo)
+{
+  return Key{ static_cast<std::uint64_t>(dirinfo.st_dev),
+              static_cast<std::uint64_t>(dirinfo.st_ino) };
+}
+
+Snapshot::Directory
+Snapshot::timesof(const struct stat& dirinfo)
+{
+  Directory d{};
+  d.mtime = dirinfo.st_mtime;
+  d.ctime = dirinfo.st_ctime;
+#if defined(HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC)
+  d.mtimensec = dirinfo.st_mtim.tv_nsec;
+  d.ctimensec = dirinfo.st_ctim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC_TV_NSEC)
+  d.mtimensec = dirinfo.st_mtimespec.tv_nsec;
+  d.ctimensec = dirinfo.st_ctimespec.tv_nsec;
+#endif
+  return d;
+}
+
+const std::string*
+Snapshot::find(const struct stat& dirinfo)
+{
+  const Directory now = timesof(dirinfo);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  const auto it = m_dirs.find(keyof(dirinfo));
+  if (it == m_dirs.end() || it->second.mtime != now.mtime ||
+      it->second.mtimensec != now.mtimensec ||
+      it->second.ctime != now.ctime || it->second.ctimensec != now.ctimensec) {
+    return nullptr;
+  }
+  it->second.seen = true;
+  ++m_nreused;
+  return &it->second.entries;
+}
+
+void
+Snapshot::store(const struct stat& dirinfo, std::string entries)
+{
+  ++m_nread;
+  Directory d = timesof(dirinfo);
+  // a directory changed during the last second may change again without
+  // the times changing, if the file system has coarse timestamps.
+  if (d.ctime >= m_started - 1 || d.mtime >= m_started - 1) {
+    return;
+  }
+  d.seen = true;
+  d.entries = std::move(entries);
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_dirs[keyof(dirinfo)] = std::move(d);
+}
+
+void
+Snapshot::addfile(std::string& entries, const char* name)
+{
+  entries.push_back(REGULAR);
+  entries.append(name, std::strlen(name) + 1);
+}
+
+void
+Snapshot::adddirectory(std::string& entries, const char* name)
+{
+  entries.push_back(SUBDIR);
+  entries.append(name, std::strlen(name) + 1);
+}
+
+void
+Snapshot::addsymlink(std::string& entries, const char* name)
+{
+  entries.push_back(SYMLINK);
+  entries.append(name, std::strlen(name) + 1);
+}
+
+bool
+Snapshot::next(const std::string& entries, std::size_t& pos, Entry& e)
+{
+  // the kind, then a name which must end before entries does
+  if (pos >= entries.size()) {
+    return false;
+  }
+  const char* p = entries.data() + pos;
+  const std::size_t left = entries.size() - pos - 1;
+  const void* end = std::memchr(p + 1, '\0', left);
+  if (end == nullptr) {
+    return false;
+  }
+  e.kind = *p;
+  e.name = p + 1;
+  pos = static_cast<std::size_t>(static_cast<const char*>(end) -
+                                 entries.data()) +
+        1;
+  return true;
+}
+
+bool
+Snapshot::isvalid(const std::string& entries)
+{
+  Entry e;
+  std::size_t pos = 0;
+  while (next(entries, pos, e)) {
+    if (e.kind != REGULAR && e.kind != SUBDIR && e.kind != SYMLINK) {
+      return false;
+    }
+  }
+  return pos == entries.size();
+}
+
+bool
+Snapshot::load(const std::string& file)
+{
+  std::ifstream in(file, std::ios::binary);
+  if (!in) {
+    // no snapshot yet, everything is read
+    return errno == ENOENT;
+  }
+  char header[sizeof(magic) - 1];
+  if (!in.read(header, sizeof(header)) ||
+      0 != std::memcmp(header, magic, sizeof(header))) {
+    return false;
+  }
+  // each directory is stored as device, inode, the four times, the size
+  // of the entries and the entries. they are only kept if all of the file
+  // could be read.
+  decltype(m_dirs) dirs;
+  char fixed[3 * sizeof(std::uint64_t) + 2 * sizeof(std::time_t) +
+             2 * sizeof(long)];
+  while (in.read(fixed, sizeof(fixed))) {
+    const char* p = fixed;
+    Key key{};
+    key.device = readint<std::uint64_t>(p);
+    key.inode = readint<std::uint64_t>(p);
+    Directory d{};
+    d.mtime = readint<std::time_t>(p);
+    d.mtimensec = readint<long>(p);
+    d.ctime = readint<std::time_t>(p);
+    d.ctimensec = readint<long>(p);
+    const auto length = readint<std::uint64_t>(p);
+    if (length > (1ULL << 40)) {
+      return false;
+    }
+    d.entries.resize(static_cast<std::size_t>(length));
+    if (length > 0 &&
+        !in.read(&d.entries[0], static_cast<std::streamsize>(length))) {
+      return false;
+    }
+    if (!isvalid(d.entries)) {
+      return false;
+    }
+    dirs[key] = std::move(d);
+  }
+  // the file must end between two directories
+  if (!in.eof() || in.gcount() != 0) {
+    return false;
+  }
+  m_dirs.swap(dirs);
+  return true;
+}
+
+bool
+Snapshot::save(const std::string& file) const
+{
+  // write to a temporary file and rename it, so a failed write does not
+  // destroy the previous snapshot
+  const std::string tmp = file + ".tmp";
+  {
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    out.write(magic, sizeof(magic) - 1);
+    std::string fixed;
+    for (const auto& it : m_dirs) {
+      const Directory& d = it.second;
+      if (!d.seen) {
+        continue;
+      }
+      fixed.clear();
+      appendint(fixed, it.first.device);
+      appendint(fixed, it.first.inode);
+      appendint(fixed, d.mtime);
+      appendint(fixed, d.mtimensec);
+      appendint(fixed, d.ctime);
+      appendint(fixed, d.ctimensec);
+      appendint<std::uint64_t>(fixed, d.entries.size());
+      out.write(fixed.data(), static_cast<std::streamsize>(fixed.size()));
+      out.write(d.entries.data(),
+                static_cast<std::streamsize>(d.entries.size()));
+    }
+    out.close();
+    if (!out) {
+      std::remove(tmp.c_str());
+      return false;
+    }
+  }
+  return 0 == std::rename(tmp.c_str(), file.c_str());
+}
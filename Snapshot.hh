@@ -0,0 +1,132 @@
+/*
+   copyright 2026 Paul Dreik
+   Distributed under GPL v 2.0 or later, at your option.
+   See LICENSE for further details.
+*/
+#ifndef RDFIND_SNAPSHOT_HH_
+#define RDFIND_SNAPSHOT_HH_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// os specific headers
+#include <sys/stat.h>
+
+/**
+ * The entries of the directories found during a run, kept so that the next
+ * run does not have to read the directories that did not change since.
+ * A directory is identified by its device and inode, and is considered
+ * unchanged if its modification and status change times are the same.
+ *
+ * The entries of a directory are kept as a sequence of records, each a
+ * kind character followed by the name with a terminating zero. Only the
+ * names are kept: writing to a file does not change its directory, so the
+ * files of a reused directory are statted again.
+ *
+ * Looking up and storing directories is thread safe.
+ */
+class Snapshot
+{
+public:
+  /// the kinds of records
+  enum : char
+  {
+    REGULAR = 'r', // a regular file
+    SUBDIR = 'd',  // a subdirectory
+    SYMLINK = 'l', // a symlink, the target is statted again
+  };
+
+  /// one record, as read by next
+  struct Entry
+  {
+    char kind;
+    const char* name;
+  };
+
+  Snapshot();
+  Snapshot(const Snapshot&) = delete;
+  Snapshot& operator=(const Snapshot&) = delete;
+
+  /// reads the snapshot in file. a missing file is an empty snapshot.
+  /// returns false if the file could not be read, nothing is kept from it
+  /// then.
+  bool load(const std::string& file);
+
+  /// writes the directories seen during this run to file. returns false on
+  /// failure.
+  bool save(const std::string& file) const;
+
+  /// gets the entries of the directory with the information dirinfo, if it
+  /// is unchanged since the snapshot was taken, otherwise nullptr. the
+  /// entries are valid as long as the snapshot lives.
+  const std::string* find(const struct stat& dirinfo);
+
+  /// stores the entries of the directory with the information dirinfo,
+  /// which was just read.
+  void store(const struct stat& dirinfo, std::string entries);
+
+  /// appends a record to entries
+  static void addfile(std::string& entries, const char* name);
+  static void adddirectory(std::string& entries, const char* name);
+  static void addsymlink(std::string& entries, const char* name);
+
+  /// reads the record at pos in entries and advances pos past it. returns
+  /// false at the end, or if the rest of entries is not a whole record.
+  static bool next(const std::string& entries, std::size_t& pos, Entry& e);
+
+  /// how many directories were found unchanged and how many were read
+  std::size_t nreused() const { return m_nreused; }
+  std::size_t nread() const { return m_nread; }
+
+private:
+  struct Key
+  {
+    std::uint64_t device;
+    std::uint64_t inode;
+    bool operator==(const Key& other) const
+    {
+      return device == other.device && inode == other.inode;
+    }
+  };
+  struct Hash
+  {
+    std::size_t operator()(const Key& key) const
+    {
+      return std::hash<std::uint64_t>()(key.inode * 31 + key.device);
+    }
+  };
+  struct Directory
+  {
+    std::time_t mtime;
+    long mtimensec;
+    std::time_t ctime;
+    long ctimensec;
+    // if it was seen during this run, only those are saved
+    bool seen;
+    std::string entries;
+  };
+
+  // true if entries is a sequence of whole records of known kinds
+  [[gnu::pure]] static bool isvalid(const std::string& entries);
+
+  // fills in the key and times of a directory from its information
+  [[gnu::pure]] static Key keyof(const struct stat& dirinfo);
+  [[gnu::pure]] static Directory timesof(const struct stat& dirinfo);
+
+  std::mutex m_mutex;
+  std::unordered_map<Key, Directory, Hash> m_dirs;
+
+  // directories changed this recently are not stored, they may change
+  // again within the resolution of the timestamps
+  std::time_t m_started;
+
+  std::atomic<std::size_t> m_nreused;
+  std::atomic<std::size_t> m_nread;
+};
+
+#endif /* RDFIND_SNAPSHOT_HH_ */
@@ -0,0 +1,352 @@
+/*
+   copyright 2026 Paul Dreik
+   Distributed under GPL v 2.0 or later, at your option.
+   See LICENSE for further details.
+*/
+
+#include "config.h"
+
+// std
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// os
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(HAVE_LINUX_IO_URING_H) && HAVE_DECL___NR_IO_URING_SETUP &&      \
+  HAVE_DECL___NR_IO_URING_ENTER && HAVE_DECL___NR_IO_URING_REGISTER &&      \
+  defined(HAVE_STRUCT_STATX)
+#define STATXRING_USE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#endif
+
+// project
+#include "StatxRing.hh"
+
+#ifdef STATXRING_USE_IO_URING
+
+namespace {
+// a shared mapping of the kernel ring memory
+class Mapping
+{
+public:
+  Mapping() = default;
+  Mapping(const Mapping&) = delete;
+  Mapping& operator=(const Mapping&) = delete;
+  ~Mapping()
+  {
+    if (m_ptr != nullptr) {
+      (void)munmap(m_ptr, m_size);
+    }
+  }
+  bool map(int fd, std::size_t size, off_t offset)
+  {
+    void* p = mmap(nullptr,
+                   size,
+                   PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE,
+                   fd,
+                   offset);
+    if (p == MAP_FAILED) {
+      return false;
+    }
+    m_ptr = static_cast<char*>(p);
+    m_size = size;
+    return true;
+  }
+  template<typename T>
+  T* at(std::uint32_t offset) const
+  {
+    return static_cast<T*>(static_cast<void*>(m_ptr + offset));
+  }
+
+private:
+  char* m_ptr{};
+  std::size_t m_size{};
+};
+
+std::uint32_t
+load_acquire(const std::uint32_t* p)
+{
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void
+store_release(std::uint32_t* p, std::uint32_t value)
+{
+  __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+// converts the parts of statx the program uses into a struct stat.
+void
+tostat(const struct statx& from, struct stat& to)
+{
+  std::memset(&to, 0, sizeof(to));
+  to.st_mode = from.stx_mode;
+  to.st_size = static_cast<off_t>(from.stx_size);
+  to.st_ino = from.stx_ino;
+  to.st_dev = makedev(from.stx_dev_major, from.stx_dev_minor);
+  to.st_nlink = from.stx_nlink;
+}
+} // namespace
+
+class StatxRing::Impl
+{
+public:
+  Impl() = default;
+  Impl(const Impl&) = delete;
+  Impl& operator=(const Impl&) = delete;
+  ~Impl()
+  {
+    if (m_fd >= 0) {
+      (void)close(m_fd);
+    }
+  }
+
+  // sets up the ring. returns false if io_uring or statx is not supported.
+  bool setup(unsigned entries)
+  {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    const long fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) {
+      return false;
+    }
+    m_fd = static_cast<int>(fd);
+
+    if (!supportsstatx()) {
+      return false;
+    }
+
+    const std::size_t sqsize =
+      params.sq_off.array + params.sq_entries * sizeof(std::uint32_t);
+    const std::size_t cqsize =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (!m_sqring.map(m_fd, sqsize, IORING_OFF_SQ_RING) ||
+        !m_cqring.map(m_fd, cqsize, IORING_OFF_CQ_RING) ||
+        !m_sqes.map(
+          m_fd, params.sq_entries * sizeof(io_uring_sqe), IORING_OFF_SQES)) {
+      return false;
+    }
+
+    m_sqtail = m_sqring.at<std::uint32_t>(params.sq_off.tail);
+    m_sqmask = *m_sqring.at<std::uint32_t>(params.sq_off.ring_mask);
+    m_sqarray = m_sqring.at<std::uint32_t>(params.sq_off.array);
+    m_cqhead = m_cqring.at<std::uint32_t>(params.cq_off.head);
+    m_cqtail = m_cqring.at<std::uint32_t>(params.cq_off.tail);
+    m_cqmask = *m_cqring.at<std::uint32_t>(params.cq_off.ring_mask);
+    m_cqes = m_cqring.at<io_uring_cqe>(params.cq_off.cqes);
+    m_sqearray = m_sqes.at<io_uring_sqe>(0);
+
+    m_capacity = params.sq_entries;
+    m_buffers.resize(m_capacity);
+    m_results.resize(m_capacity);
+    return true;
+  }
+
+  std::size_t capacity() const { return m_capacity; }
+
+  void add(int dirfd, const char* name, bool follow, Result* result)
+  {
+    const std::uint32_t slot = m_queued++;
+    const std::uint32_t tail = *m_sqtail;
+    const std::uint32_t index = tail & m_sqmask;
+    io_uring_sqe& sqe = m_sqearray[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_STATX;
+    sqe.fd = dirfd;
+    sqe.addr = reinterpret_cast<std::uintptr_t>(name);
+    sqe.len =
+      STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_INO | STATX_NLINK;
+    sqe.off = reinterpret_cast<std::uintptr_t>(&m_buffers[slot]);
+    sqe.statx_flags = follow ? 0U : unsigned{ AT_SYMLINK_NOFOLLOW };
+    sqe.user_data = slot;
+    m_results[slot] = result;
+    m_sqarray[index] = index;
+    store_release(m_sqtail, tail + 1);
+  }
+
+  int submitandwait()
+  {
+    std::uint32_t tosubmit = m_queued - m_submitted;
+    while (m_completed < m_queued) {
+      const long ret = syscall(__NR_io_uring_enter,
+                               m_fd,
+                               tosubmit,
+                               1U,
+                               IORING_ENTER_GETEVENTS,
+                               nullptr,
+                               0);
+      if (ret < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+          m_completed += reap();
+          continue;
+        }
+        // the ring is given up, but what was submitted may still complete
+        drain();
+        return -1;
+      }
+      tosubmit -= static_cast<std::uint32_t>(ret);
+      m_submitted += static_cast<std::uint32_t>(ret);
+      m_completed += reap();
+    }
+    m_queued = m_submitted = m_completed = 0;
+    return 0;
+  }
+
+  // true if submitted requests may still write to the buffers
+  bool inflight() const { return m_completed < m_submitted; }
+
+private:
+  // checks that the kernel knows about IORING_OP_STATX (linux 5.6)
+  bool supportsstatx() const
+  {
+    const std::size_t nops = IORING_OP_STATX + 1;
+    std::vector<char> storage(sizeof(io_uring_probe) +
+                              nops * sizeof(io_uring_probe_op));
+    io_uring_probe* probe =
+      static_cast<io_uring_probe*>(static_cast<void*>(storage.data()));
+    if (syscall(__NR_io_uring_register,
+                m_fd,
+                IORING_REGISTER_PROBE,
+                probe,
+                static_cast<unsigned>(nops)) < 0) {
+      return false;
+    }
+    return probe->last_op >= IORING_OP_STATX &&
+           (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED);
+  }
+
+  // waits for the completions of the submitted requests, without submitting
+  // more. gives up if the kernel does not let it wait.
+  void drain()
+  {
+    while (inflight()) {
+      const long ret = syscall(
+        __NR_io_uring_enter, m_fd, 0U, 1U, IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        return;
+      }
+      m_completed += reap();
+    }
+  }
+
+  // processes the available completions, returns how many there were
+  std::uint32_t reap()
+  {
+    std::uint32_t head = *m_cqhead;
+    const std::uint32_t tail = load_acquire(m_cqtail);
+    std::uint32_t n = 0;
+    for (; head != tail; ++head, ++n) {
+      const io_uring_cqe& cqe = m_cqes[head & m_cqmask];
+      const auto slot = static_cast<std::size_t>(cqe.user_data);
+      Result* result = m_results[slot];
+      if (cqe.res < 0) {
+        result->error = -cqe.res;
+      } else {
+        result->error = 0;
+        tostat(m_buffers[slot], result->info);
+      }
+    }
+    store_release(m_cqhead, head);
+    return n;
+  }
+
+  int m_fd = -1;
+  Mapping m_sqring;
+  Mapping m_cqring;
+  Mapping m_sqes;
+  std::uint32_t* m_sqtail{};
+  std::uint32_t m_sqmask{};
+  std::uint32_t* m_sqarray{};
+  std::uint32_t* m_cqhead{};
+  std::uint32_t* m_cqtail{};
+  std::uint32_t m_cqmask{};
+  io_uring_cqe* m_cqes{};
+  io_uring_sqe* m_sqearray{};
+  std::size_t m_capacity{};
+
+  // requests queued, submitted and completed since the last submitandwait()
+  std::uint32_t m_queued{};
+  std::uint32_t m_submitted{};
+  std::uint32_t m_completed{};
+
+  // per request slot, where the kernel writes and where to deliver it
+  std::vector<struct statx> m_buffers;
+  std::vector<Result*> m_results;
+};
+
+StatxRing::StatxRing(unsigned entries)
+  : m_impl(new Impl)
+{
+  if (!m_impl->setup(entries)) {
+    m_impl.reset();
+  }
+}
+
+std::size_t
+StatxRing::capacity() const
+{
+  return m_impl->capacity();
+}
+
+void
+StatxRing::add(int dirfd, const char* name, bool follow, Result* result)
+{
+  m_impl->add(dirfd, name, follow, result);
+}
+
+int
+StatxRing::submitandwait()
+{
+  const int ret = m_impl->submitandwait();
+  if (ret != 0) {
+    // the ring is not used again, since completions of requests it could
+    // not wait for would be taken for those of the next batch. such
+    // requests may still write to its buffers, so then it is never freed.
+    if (m_impl->inflight()) {
+      (void)m_impl.release();
+    } else {
+      m_impl.reset();
+    }
+  }
+  return ret;
+}
+
+#else // STATXRING_USE_IO_URING
+
+// io_uring is not available, ok() is always false.
+class StatxRing::Impl
+{};
+
+StatxRing::StatxRing(unsigned /*entries*/) {}
+
+std::size_t
+StatxRing::capacity() const
+{
+  return 0;
+}
+
+void
+StatxRing::add(int /*dirfd*/,
+               const char* /*name*/,
+               bool /*follow*/,
+               Result* /*result*/)
+{}
+
+int
+StatxRing::submitandwait()
+{
+  return -1;
+}
+
+#endif // STATXRING_USE_IO_URING
+
+StatxRing::~StatxRing() = default;
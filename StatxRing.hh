@@ -0,0 +1,71 @@
+/*
+   copyright 2026 Paul Dreik
+   Distributed under GPL v 2.0 or later, at your option.
+   See LICENSE for further details.
+*/
+#ifndef RDFIND_STATXRING_HH_
+#define RDFIND_STATXRING_HH_
+
+#include <cstddef>
+#include <memory>
+
+// os specific headers
+#include <sys/stat.h>
+
+/**
+ * Makes many stat calls at once through io_uring (linux only), instead of
+ * one system call each. Requests are queued with add() and executed
+ * together with submitandwait(). If io_uring or statx through it is not
+ * available, ok() returns false and the object must not be used.
+ * This class is not thread safe, use one object per thread.
+ */
+class StatxRing
+{
+public:
+  /// the outcome of one request
+  struct Result
+  {
+    /// zero on success, otherwise the errno value
+    int error;
+    /// the file information, valid if error is zero
+    struct stat info;
+  };
+
+  /**
+   * sets up a ring
+   * @param entries how many requests can be queued at once
+   */
+  explicit StatxRing(unsigned entries);
+  StatxRing(const StatxRing&) = delete;
+  StatxRing& operator=(const StatxRing&) = delete;
+  ~StatxRing();
+
+  /// true if the ring is usable
+  bool ok() const { return m_impl != nullptr; }
+
+  /// how many requests can be queued before submitandwait() is called
+  [[gnu::pure]] std::size_t capacity() const;
+
+  /**
+   * queues a stat of name, relative to the directory dirfd.
+   * @param follow follow symlinks (as stat does) or not (as lstat does)
+   * @param result written to on completion. name and result must stay valid
+   * until submitandwait() returns.
+   */
+  void add(int dirfd, const char* name, bool follow, Result* result);
+
+  /**
+   * submits the queued requests and waits until all of them completed.
+   * @return zero on success. on failure, the results are unspecified and
+   * the ring is torn down, ok() returns false from then on. the requests
+   * already submitted are waited for first, a ring that can not wait for
+   * them is left allocated, so they never write to freed memory.
+   */
+  int submitandwait();
+
+private:
+  class Impl;
+  std::unique_ptr<Impl> m_impl;
+};
+
+#endif /* RDFIND_STATXRING_HH_ */
@@ -8,31 +8,44 @@
 
 // std
 #include <algorithm>
+#include <functional>
 #include <iostream>
 #include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <vector>
 
 // project
 #include "CmdlineParser.hh"
+#include "Devices.hh"     //to schedule work per device
 #include "Dirlist.hh"     //to find files
 #include "Fileinfo.hh"    //file container
+#include "Manifest.hh"    //to read file lists
+#include "Mapstore.hh"    //to bound memory use
 #include "RdfindDebug.hh" //debug macro
 #include "Rdutil.hh"      //to do some work
+#include "Snapshot.hh"    //to skip unchanged directories
 
 // global variables
 
 // this vector holds the information about all files found
-std::vector<Fileinfo> filelist;
+Filelist filelist;
+// guards filelist while directories are traversed by several threads
+std::mutex filelist_mutex;
 struct Options;
 const Options* global_options{};
+// files found are added through this, guarded by filelist_mutex
+Rdutil* global_rdutil{};
 
 /**
- * this contains the command line index for the path currently
- * being investigated. it has to be global, because function pointers
- * are being used.
+ * the number of files found per command line index, guarded by
+ * filelist_mutex. the command line index of the path being investigated is
+ * passed to report as the tag of the walk.
  */
-int current_cmdline_index = 0;
+std::vector<std::size_t> files_per_cmdline_index;
 
 static void
 usage()
@@ -65,6 +78,73 @@ usage()
     << "                                  checksum type\n"
     << " -deterministic    (true)| false  makes results independent of order\n"
     << "                                  from listing the filesystem\n"
+    << " -threads N        (N=1)          traverse directories using N "
+       "threads per\n"
+    << "                                  device\n"
+    << " -readthreads N    (N=1)          read file contents using N "
+       "threads per\n"
+    << "                                  device (one on rotating disks)\n"
+    << " -sortthreads N    (N=1)          sort and group the file list "
+       "using N\n"
+    << "                                  threads\n"
+    << " -perdevice        (true)| false  traverse starting points on "
+       "different\n"
+    << "                                  devices concurrently\n"
+    << " -files-from file                 read NUL separated paths from file "
+       "(- for\n"
+    << "                                  stdin) instead of traversing, as "
+       "written by\n"
+    << "                                  find -print0\n"
+    << " -files-from-columns\n"
+    << "                    true |(false) the file list has size, device and "
+       "inode\n"
+    << "                                  columns, as find -printf "
+       "'%s %D %i %p\\0'\n"
+    << " -snapshot file                   reuse the entries of directories "
+       "unchanged\n"
+    << "                                  since the last run from file, and "
+       "update it\n"
+    << " -memlimit N       (none)         keep large tables in temporary "
+       "files and\n"
+    << "                                  sort them in runs, to use about N "
+       "bytes (K, M,\n"
+    << "                                  G suffixes allowed)\n"
+    << " -sampleblocks N    (N=0)         after the last bytes, make "
+       "checksums of N\n"
+    << "                                  blocks of 4096 bytes spread over "
+       "the files\n"
+    << " -prefixchecksums N,...           before checksums of whole files, "
+       "make\n"
+    << "                                  checksums of the first N bytes "
+       "(K, M, G\n"
+    << "                                  suffixes allowed)\n"
+    << " -twopass          true |(false) count file sizes in a first pass, "
+       "and keep\n"
+    << "                                  only files with a size found "
+       "twice in the\n"
+    << "                                  second, to save memory\n"
+    << " -lockstep         true |(false) compare the contents of candidates "
+       "directly,\n"
+    << "                                  reading them together, instead of "
+       "making\n"
+    << "                                  checksums of whole files\n"
+    << " -exclude pattern                 skip files matching the shell "
+       "pattern, can\n"
+    << "                                  be given several times\n"
+    << " -excludedir pattern              skip directories matching the "
+       "shell\n"
+    << "                                  pattern, without reading them\n"
+    << " -maxdepth N       (N=-1)         read directories at most N levels "
+       "below the\n"
+    << "                                  starting points, -1 for no limit "
+       "(49 with\n"
+    << "                                  -followsymlinks true)\n"
+    << " -order  (depthfirst)| breadthfirst\n"
+    << "                                  order to traverse directories in\n"
+    << " -dirreader   (readdir)| getdents how to read directories\n"
+    << " -dirbuffer N      (N=1048576)    buffer size in bytes for "
+       "-dirreader getdents\n"
+    << " -statengine    (sync)| uring     how to stat directory entries\n"
     << " -makesymlinks      true |(false) replace duplicate files with "
        "symbolic links\n"
     << " -makehardlinks     true |(false) replace duplicate files with "
@@ -109,9 +189,59 @@ struct Options
   bool usesha512 = false;    // use sha512 checksum to check for similarity
   bool deterministic = true; // be independent of filesystem order
   long nsecsleep = 0; // number of nanoseconds to sleep between each file read.
+  unsigned nthreads = 1; // number of threads for directory traversal
+  unsigned readthreads = 1; // number of threads reading files, per device
+  unsigned sortthreads = 1; // number of threads sorting the file list
+  bool perdevice = true;    // traverse devices concurrently
+  long long maxdepth = -1; // levels to traverse, -1 for the default
+  Dirlist::ordertype order =
+    Dirlist::ordertype::DEPTHFIRST; // directory traversal order
+  Dirlist::readertype dirreader =
+    Dirlist::readertype::READDIR; // how to read directories
+  std::size_t dirbuffersize = 1 << 20; // buffer size for getdents
+  Dirlist::statenginetype statengine =
+    Dirlist::statenginetype::SYNC; // how to stat directory entries
   std::string resultsfile = "results.txt"; // results file name.
+  std::vector<std::string> excludes;       // file name patterns to skip
+  std::vector<std::string> excludedirs;    // directory patterns to skip
+  std::string filesfrom;                   // file list to read, if any
+  int filesfromindex = 0;                  // its command line index
+  bool filesfromcolumns = false;           // if it has size/dev/inode
+  std::string snapshotfile;                // directory snapshot, if any
+  unsigned long long memlimit = 0;         // memory limit, 0 for none
+  bool twopass = false;                    // count sizes before scanning
+  std::vector<Fileinfo::filesizetype> prefixlengths; // checksummed starts
+  bool lockstep = false; // compare contents instead of whole file checksums
+  unsigned sampleblocks = 0; // blocks to sample from each file, 0 for none
 };
 
+// parses a number of bytes, with an optional K, M or G suffix. std::stoull
+// would accept a sign and wrap negative numbers, so a digit must come first.
+static unsigned long long
+parsebytes(const std::string& arg)
+{
+  if (arg.empty() || arg[0] < '0' || arg[0] > '9') {
+    throw std::invalid_argument("not a number");
+  }
+  std::size_t end = 0;
+  const unsigned long long value = std::stoull(arg, &end);
+  const std::string suffix = arg.substr(end);
+  int shift = 0;
+  if (suffix == "K" || suffix == "k") {
+    shift = 10;
+  } else if (suffix == "M" || suffix == "m") {
+    shift = 20;
+  } else if (suffix == "G" || suffix == "g") {
+    shift = 30;
+  } else if (!suffix.empty()) {
+    throw std::invalid_argument("bad suffix");
+  }
+  if (value > (std::numeric_limits<unsigned long long>::max() >> shift)) {
+    throw std::out_of_range("too large");
+  }
+  return value << shift;
+}
+
 Options
 parseOptions(Parser& parser)
 {
@@ -168,6 +298,155 @@ parseOptions(Parser& parser)
       o.remove_identical_inode = parser.get_parsed_bool();
     } else if (parser.try_parse_bool("-deterministic")) {
       o.deterministic = parser.get_parsed_bool();
+    } else if (parser.try_parse_string("-threads")) {
+      const long long nthreads = std::stoll(parser.get_parsed_string());
+      if (nthreads < 1 || nthreads > 1024) {
+        std::cerr << "expected -threads between 1 and 1024, not \""
+                  << parser.get_parsed_string() << "\"\n";
+        std::exit(EXIT_FAILURE);
+      }
+      o.nthreads = static_cast<unsigned>(nthreads);
+    } else if (parser.try_parse_string("-readthreads")) {
+      const long long readthreads = std::stoll(parser.get_parsed_string());
+      if (readthreads < 1 || readthreads > 1024) {
+        std::cerr << "expected -readthreads between 1 and 1024, not \""
+                  << parser.get_parsed_string() << "\"\n";
+        std::exit(EXIT_FAILURE);
+      }
+      o.readthreads = static_cast<unsigned>(readthreads);
+    } else if (parser.try_parse_string("-sortthreads")) {
+      const long long sortthreads = std::stoll(parser.get_parsed_string());
+      if (sortthreads < 1 || sortthreads > 1024) {
+        std::cerr << "expected -sortthreads between 1 and 1024, not \""
+                  << parser.get_parsed_string() << "\"\n";
+        std::exit(EXIT_FAILURE);
+      }
+      o.sortthreads = static_cast<unsigned>(sortthreads);
+    } else if (parser.try_parse_bool("-perdevice")) {
+      o.perdevice = parser.get_parsed_bool();
+    } else if (parser.try_parse_string("-files-from")) {
+      o.filesfrom = parser.get_parsed_string();
+      o.filesfromindex = parser.get_current_index();
+    } else if (parser.try_parse_bool("-files-from-columns")) {
+      o.filesfromcolumns = parser.get_parsed_bool();
+    } else if (parser.try_parse_string("-snapshot")) {
+      o.snapshotfile = parser.get_parsed_string();
+    } else if (parser.try_parse_string("-memlimit")) {
+      try {
+        o.memlimit = parsebytes(parser.get_parsed_string());
+      } catch (const std::logic_error&) {
+        o.memlimit = 0;
+      }
+      if (o.memlimit == 0 ||
+          o.memlimit > std::numeric_limits<std::size_t>::max()) {
+        std::cerr << "expected -memlimit as a positive number of bytes with "
+                     "an optional K, M or G suffix, not \""
+                  << parser.get_parsed_string() << "\"\n";
+        std::exit(EXIT_FAILURE);
+      }
+    } else if (parser.try_parse_string("-sampleblocks")) {
+      const long long sampleblocks = std::stoll(parser.get_parsed_string());
+      if (sampleblocks < 0 || sampleblocks > 65536) {
+        std::cerr << "expected -sampleblocks between 0 and 65536, not \""
+                  << parser.get_parsed_string() << "\"\n";
+        std::exit(EXIT_FAILURE);
+      }
+      o.sampleblocks = static_cast<unsigned>(sampleblocks);
+    } else if (parser.try_parse_string("-prefixchecksums")) {
+      const std::string list = parser.get_parsed_string();
+      o.prefixlengths.clear();
+      for (std::size_t begin = 0; begin <= list.size();) {
+        auto end = list.find(',', begin);
+        if (end == std::string::npos) {
+          end = list.size();
+        }
+        unsigned long long length = 0;
+        try {
+          length = parsebytes(list.substr(begin, end - begin));
+        } catch (const std::logic_error&) {
+          length = 0;
+        }
+        if (length == 0 ||
+            length > static_cast<unsigned long long>(
+                       std::numeric_limits<Fileinfo::filesizetype>::max())) {
+          std::cerr << "expected -prefixchecksums as a comma separated list "
+                       "of positive numbers of bytes with optional K, M or G "
+                       "suffixes, not \""
+                    << list << "\"\n";
+          std::exit(EXIT_FAILURE);
+        }
+        o.prefixlengths.push_back(
+          static_cast<Fileinfo::filesizetype>(length));
+        begin = end + 1;
+      }
+      std::sort(o.prefixlengths.begin(), o.prefixlengths.end());
+      o.prefixlengths.erase(
+        std::unique(o.prefixlengths.begin(), o.prefixlengths.end()),
+        o.prefixlengths.end());
+    } else if (parser.try_parse_bool("-lockstep")) {
+      o.lockstep = parser.get_parsed_bool();
+    } else if (parser.try_parse_bool("-twopass")) {
+      o.twopass = parser.get_parsed_bool();
+    } else if (parser.try_parse_string("-exclude")) {
+      o.excludes.emplace_back(parser.get_parsed_string());
+    } else if (parser.try_parse_string("-excludedir")) {
+      o.excludedirs.emplace_back(parser.get_parsed_string());
+    } else if (parser.try_parse_string("-maxdepth")) {
+      o.maxdepth = std::stoll(parser.get_parsed_string());
+      if (o.maxdepth < -1 || o.maxdepth > std::numeric_limits<int>::max()) {
+        std::cerr << "expected -maxdepth -1 or larger, not \""
+                  << parser.get_parsed_string() << "\"\n";
+        std::exit(EXIT_FAILURE);
+      }
+    } else if (parser.try_parse_string("-order")) {
+      if (parser.parsed_string_is("depthfirst")) {
+        o.order = Dirlist::ordertype::DEPTHFIRST;
+      } else if (parser.parsed_string_is("breadthfirst")) {
+        o.order = Dirlist::ordertype::BREADTHFIRST;
+      } else {
+        std::cerr << "expected depthfirst/breadthfirst, not \""
+                  << parser.get_parsed_string() << "\"\n";
+        std::exit(EXIT_FAILURE);
+      }
+    } else if (parser.try_parse_string("-dirreader")) {
+      if (parser.parsed_string_is("readdir")) {
+        o.dirreader = Dirlist::readertype::READDIR;
+      } else if (parser.parsed_string_is("getdents")) {
+        if (!Dirlist::hasgetdents()) {
+          std::cerr << "-dirreader getdents is not supported on this "
+                       "system\n";
+          std::exit(EXIT_FAILURE);
+        }
+        o.dirreader = Dirlist::readertype::GETDENTS;
+      } else {
+        std::cerr << "expected readdir/getdents, not \""
+                  << parser.get_parsed_string() << "\"\n";
+        std::exit(EXIT_FAILURE);
+      }
+    } else if (parser.try_parse_string("-statengine")) {
+      if (parser.parsed_string_is("sync")) {
+        o.statengine = Dirlist::statenginetype::SYNC;
+      } else if (parser.parsed_string_is("uring")) {
+        if (Dirlist::hasuring()) {
+          o.statengine = Dirlist::statenginetype::URING;
+        } else {
+          std::cerr << "-statengine uring is not supported on this system, "
+                       "using sync instead\n";
+          o.statengine = Dirlist::statenginetype::SYNC;
+        }
+      } else {
+        std::cerr << "expected sync/uring, not \""
+                  << parser.get_parsed_string() << "\"\n";
+        std::exit(EXIT_FAILURE);
+      }
+    } else if (parser.try_parse_string("-dirbuffer")) {
+      const long long dirbuffersize = std::stoll(parser.get_parsed_string());
+      if (dirbuffersize < 4096 || dirbuffersize > (1LL << 30)) {
+        std::cerr << "expected -dirbuffer between 4096 and 1073741824, not \""
+                  << parser.get_parsed_string() << "\"\n";
+        std::exit(EXIT_FAILURE);
+      }
+      o.dirbuffersize = static_cast<std::size_t>(dirbuffersize);
     } else if (parser.try_parse_string("-checksum")) {
       if (parser.parsed_string_is("md5")) {
         o.usemd5 = true;
@@ -228,8 +507,17 @@ parseOptions(Parser& parser)
   if (o.maximumfilesize == 0) {
     o.maximumfilesize = std::numeric_limits<decltype(o.maximumfilesize)>::max();
   }
+  // without a limit, symlink loops would be followed forever
+  if (o.maxdepth == -1 && o.followsymlinks) {
+    o.maxdepth = 49;
+  }
 
   // verify conflicting arguments
+  if (o.twopass && o.filesfrom == "-") {
+    std::cerr << "-twopass needs to read the file list twice, it can not be "
+                 "read from stdin\n";
+    std::exit(EXIT_FAILURE);
+  }
   if (!(o.minimumfilesize < o.maximumfilesize)) {
     std::cerr << "maximum filesize " << o.maximumfilesize
               << " must be larger than minimum filesize " << o.minimumfilesize
@@ -246,30 +534,68 @@ parseOptions(Parser& parser)
   return o;
 }
 
-// function to add items to the list of all files
+// function to add items to the list of all files. may be called
+// concurrently when traversing with several threads. info is the result of
+// stat on the file, already made during the traversal.
 static int
-report(const std::string& path, const std::string& name, int depth)
+report(const std::string& path,
+       const char* name,
+       int depth,
+       const struct stat& info,
+       int cmdline_index)
 {
 
-  RDDEBUG("report(" << path.c_str() << "," << name.c_str() << "," << depth
-                    << ")" << std::endl);
+  RDDEBUG("report(" << path.c_str() << "," << name << "," << depth << ")"
+                    << std::endl);
 
-  // expand the name if the path is nonempty
-  std::string expandedname = path.empty() ? name : (path + "/" + name);
+  if (!S_ISREG(info.st_mode) ||
+      info.st_size < global_options->minimumfilesize ||
+      info.st_size >= global_options->maximumfilesize) {
+    return 0;
+  }
 
-  Fileinfo tmp(std::move(expandedname), current_cmdline_index, depth);
-  if (tmp.readfileinfo()) {
-    if (tmp.isRegularFile()) {
-      const auto size = tmp.size();
-      if (size >= global_options->minimumfilesize &&
-          size < global_options->maximumfilesize) {
-        filelist.emplace_back(std::move(tmp));
-      }
-    }
-  } else {
-    std::cerr << "failed to read file info on file \"" << tmp.name() << '\n';
-    return -1;
+  // in the second pass of -twopass, a file with a size found once is only
+  // counted
+  if (!global_rdutil->sizeshared(info.st_size)) {
+    std::lock_guard<std::mutex> lock(filelist_mutex);
+    global_rdutil->skipfile(info.st_size);
+    ++files_per_cmdline_index[static_cast<std::size_t>(cmdline_index)];
+    return 0;
+  }
+
+  // the file is kept. files are reported directory by directory, so the
+  // directory is only looked up when it changes.
+  thread_local std::string lastpath;
+  thread_local Pathtable::dirid lastdir = Pathtable::nodirectory;
+  if (path != lastpath) {
+    lastdir = Fileinfo::paths().adddirectory(path);
+    lastpath = path;
+  }
+
+  Fileinfo tmp(lastdir, name, cmdline_index, depth);
+  tmp.fillfileinfo(info);
+  std::lock_guard<std::mutex> lock(filelist_mutex);
+  global_rdutil->addfile(std::move(tmp));
+  ++files_per_cmdline_index[static_cast<std::size_t>(cmdline_index)];
+  return 0;
+}
+
+// function to count the sizes of files in the first pass of -twopass. it
+// takes the same arguments as report, and skips the same files.
+static int
+countsize(const std::string&,
+          const char*,
+          int,
+          const struct stat& info,
+          int)
+{
+  if (!S_ISREG(info.st_mode) ||
+      info.st_size < global_options->minimumfilesize ||
+      info.st_size >= global_options->maximumfilesize) {
+    return 0;
   }
+  std::lock_guard<std::mutex> lock(filelist_mutex);
+  global_rdutil->countsize(info.st_size);
   return 0;
 }
 
@@ -286,27 +612,64 @@ main(int narg, const char* argv[])
 
   const Options o = parseOptions(parser);
 
+  // large arrays go to mapped files from now on, if there is a limit
+  Mapstore::setlimit(static_cast<std::size_t>(o.memlimit));
+
   // set the dryrun string
   const std::string dryruntext(o.dryrun ? "(DRYRUN MODE) " : "");
 
   // an object to do sorting and duplicate finding
   Rdutil gswd(filelist);
-
-  // an object to traverse the directory structure
-  Dirlist dirlist(o.followsymlinks);
+  gswd.setnthreads(o.sortthreads);
 
   // this is what function is called when an object is found on
   // the directory traversed by walk. Make sure the pointer to the
   // options is set as well.
   global_options = &o;
-  dirlist.setcallbackfcn(&report);
+  global_rdutil = &gswd;
+  files_per_cmdline_index.resize(static_cast<std::size_t>(narg));
+
+  // the directories found by the last run, if a snapshot is used
+  Snapshot snapshot;
+  if (!o.snapshotfile.empty() && !snapshot.load(o.snapshotfile)) {
+    std::cerr << "could not read snapshot \"" << o.snapshotfile
+              << "\", directories not found in it are read\n";
+  }
+
+  // makes an object to traverse the directory structure
+  auto makedirlist = [&o, &snapshot](decltype(&report) callback) {
+    std::unique_ptr<Dirlist> dirlist(new Dirlist(o.followsymlinks));
+    dirlist->setnthreads(o.nthreads);
+    dirlist->setmaxdepth(static_cast<int>(o.maxdepth));
+    dirlist->setorder(o.order);
+    dirlist->setreader(o.dirreader, o.dirbuffersize);
+    dirlist->setstatengine(o.statengine);
+    for (const auto& pattern : o.excludes) {
+      dirlist->addexclude(pattern);
+    }
+    for (const auto& pattern : o.excludedirs) {
+      dirlist->addexcludedir(pattern);
+    }
+    if (!o.snapshotfile.empty()) {
+      dirlist->setsnapshot(&snapshot);
+    }
+    dirlist->setcallbackfcn(callback);
+    return dirlist;
+  };
 
-  // now loop over path list and add the files
+  // now loop over path list and collect the starting points, grouped by
+  // the device they are on.
+  struct Startingpoint
+  {
+    std::string path;
+    int cmdline_index;
+  };
+  std::vector<std::pair<unsigned long, std::vector<Startingpoint>>> devices;
 
   // done with arguments. start parsing files and directories!
   for (; parser.has_args_left(); parser.advance()) {
     // get the next arg.
-    const std::string file_or_dir = [&]() {
+    std::string file_or_dir = [&]() {
       std::string arg(parser.get_current_arg());
       // remove trailing /
       while (arg.back() == '/' && arg.size() > 1) {
@@ -315,22 +678,118 @@ main(int narg, const char* argv[])
       return arg;
     }();
 
-    auto lastsize = filelist.size();
-    std::cout << dryruntext << "Now scanning \"" << file_or_dir << "\"";
-    std::cout.flush();
-    current_cmdline_index = parser.get_current_index();
-    dirlist.walk(file_or_dir, 0);
-    std::cout << ", found " << filelist.size() - lastsize << " files."
-              << std::endl;
+    const unsigned long device =
+      o.perdevice ? Devices::deviceof(file_or_dir) : 0;
+    auto it = std::find_if(
+      devices.begin(),
+      devices.end(),
+      [device](const decltype(devices)::value_type& d) {
+        return d.first == device;
+      });
+    if (it == devices.end()) {
+      devices.emplace_back(device, std::vector<Startingpoint>{});
+      it = devices.end() - 1;
+    }
+    it->second.push_back(
+      Startingpoint{ std::move(file_or_dir), parser.get_current_index() });
+  }
+
+  // reads the file list and traverses the starting points, passing each
+  // file found to callback
+  auto scan = [&](decltype(&report) callback, bool verbose) {
+    // a file list is read before any directories, since it was given first
+    if (!o.filesfrom.empty()) {
+      if (verbose) {
+        std::cout << dryruntext << "Now reading file list \"" << o.filesfrom
+                  << "\"";
+        std::cout.flush();
+      }
+      Manifest manifest(o.followsymlinks, o.filesfromcolumns);
+      manifest.setcallbackfcn(callback);
+      if (manifest.read(o.filesfrom, o.filesfromindex) != 0) {
+        std::exit(EXIT_FAILURE);
+      }
+      if (verbose) {
+        std::cout << ", found "
+                  << files_per_cmdline_index[static_cast<std::size_t>(
+                       o.filesfromindex)]
+                  << " files." << std::endl;
+      }
+    }
+
+    if (devices.size() == 1) {
+      auto dirlist = makedirlist(callback);
+      for (const auto& start : devices.front().second) {
+        if (verbose) {
+          std::cout << dryruntext << "Now scanning \"" << start.path << "\"";
+          std::cout.flush();
+        }
+        dirlist->walk(start.path, 0, start.cmdline_index);
+        if (verbose) {
+          std::cout << ", found "
+                    << files_per_cmdline_index[static_cast<std::size_t>(
+                         start.cmdline_index)]
+                    << " files." << std::endl;
+        }
+      }
+    } else {
+      // traverse each device in its own thread, so independent disks work at
+      // the same time
+      std::mutex cout_mutex;
+      auto scandevice = [&](const std::vector<Startingpoint>& starts) {
+        auto dirlist = makedirlist(callback);
+        for (const auto& start : starts) {
+          dirlist->walk(start.path, 0, start.cmdline_index);
+          if (!verbose) {
+            continue;
+          }
+          std::size_t nfound = 0;
+          {
+            std::lock_guard<std::mutex> lock(filelist_mutex);
+            nfound = files_per_cmdline_index[static_cast<std::size_t>(
+              start.cmdline_index)];
+          }
+          std::lock_guard<std::mutex> lock(cout_mutex);
+          std::cout << dryruntext << "Now scanning \"" << start.path
+                    << "\", found " << nfound << " files." << std::endl;
+        }
+      };
+      std::vector<std::thread> threads;
+      for (const auto& d : devices) {
+        threads.emplace_back(scandevice, std::cref(d.second));
+      }
+      for (auto& t : threads) {
+        t.join();
+      }
+    }
+  };
 
-    // if we want deterministic output, we will sort the newly added
-    // items on depth, then filename.
-    if (o.deterministic) {
-      gswd.sort_on_depth_and_name(lastsize);
+  if (o.twopass) {
+    // the first pass only counts sizes, so the second pass does not need to
+    // keep files with a size found once
+    scan(&countsize, false);
+    const std::size_t ncounted = gswd.ncounted();
+    const std::size_t nshared = gswd.endcount();
+    std::cout << dryruntext << "Counted " << ncounted
+              << " files in a first pass, " << nshared
+              << " have a size found more than once." << std::endl;
+  }
+  scan(&report, true);
+
+  if (!o.snapshotfile.empty()) {
+    std::cout << dryruntext << "Reused " << snapshot.nreused() << " of "
+              << snapshot.nreused() + snapshot.nread()
+              << " directories from the snapshot." << std::endl;
+    if (!snapshot.save(o.snapshotfile)) {
+      std::cerr << "failed to write snapshot \"" << o.snapshotfile << "\"\n";
     }
   }
 
-  std::cout << dryruntext << "Now have " << filelist.size()
+  // put the files in command line order. if we want deterministic output,
+  // the items of each starting point are sorted on depth, then filename.
+  gswd.sort_on_cmdline_index(o.deterministic);
+
+  std::cout << dryruntext << "Now have " << gswd.nfiles()
             << " files in total." << std::endl;
 
   // mark files with a number for correct ranking. The only ordering at this
@@ -354,45 +813,94 @@ main(int narg, const char* argv[])
 
   // ok. we now need to do something stronger to disambiguate the duplicate
   // candidates. start looking at the contents.
-  std::vector<std::pair<Fileinfo::readtobuffermode, const char*>> modes{
-    { Fileinfo::readtobuffermode::NOT_DEFINED, "" },
-    { Fileinfo::readtobuffermode::READ_FIRST_BYTES, "first bytes" },
-    { Fileinfo::readtobuffermode::READ_LAST_BYTES, "last bytes" },
+  // the stages of elimination. a length is given for checksums of only the
+  // start of the files.
+  struct Stage
+  {
+    Fileinfo::readtobuffermode mode;
+    Fileinfo::filesizetype length;
+    std::string description;
+  };
+  std::vector<Stage> modes{
+    { Fileinfo::readtobuffermode::NOT_DEFINED, 0, "" },
+    { Fileinfo::readtobuffermode::READ_FIRST_BYTES, 0, "first bytes" },
+    { Fileinfo::readtobuffermode::READ_LAST_BYTES, 0, "last bytes" },
   };
   if (o.usemd5) {
-    modes.emplace_back(Fileinfo::readtobuffermode::CREATE_MD5_CHECKSUM,
-                       "md5 checksum");
+    modes.push_back(Stage{
+      Fileinfo::readtobuffermode::CREATE_MD5_CHECKSUM, 0, "md5 checksum" });
   }
   if (o.usesha1) {
-    modes.emplace_back(Fileinfo::readtobuffermode::CREATE_SHA1_CHECKSUM,
-                       "sha1 checksum");
+    modes.push_back(Stage{
+      Fileinfo::readtobuffermode::CREATE_SHA1_CHECKSUM, 0, "sha1 checksum" });
   }
   if (o.usesha256) {
-    modes.emplace_back(Fileinfo::readtobuffermode::CREATE_SHA256_CHECKSUM,
-                       "sha256 checksum");
+    modes.push_back(Stage{ Fileinfo::readtobuffermode::CREATE_SHA256_CHECKSUM,
+                           0,
+                           "sha256 checksum" });
   }
   if (o.usesha512) {
-    modes.emplace_back(Fileinfo::readtobuffermode::CREATE_SHA512_CHECKSUM,
-                       "sha512 checksum");
+    modes.push_back(Stage{ Fileinfo::readtobuffermode::CREATE_SHA512_CHECKSUM,
+                           0,
+                           "sha512 checksum" });
   }
 
-  for (auto it = modes.begin() + 1; it != modes.end(); ++it) {
-    std::cout << dryruntext << "Now eliminating candidates based on "
-              << it->second << ": " << std::flush;
+  // checksums of the start of the files go before the first checksum of
+  // whole files, of the same kind so files shorter than the start are not
+  // read again.
+  const std::size_t firstchecksum = 3;
+  const Stage whole = modes[firstchecksum];
+  for (auto length = o.prefixlengths.rbegin(); length != o.prefixlengths.rend();
+       ++length) {
+    modes.insert(modes.begin() + firstchecksum,
+                 Stage{ whole.mode,
+                        *length,
+                        whole.description + " of the first " +
+                          std::to_string(*length) + " bytes" });
+  }
+  if (o.lockstep) {
+    // the contents are compared instead of the checksums of whole files
+    modes.erase(modes.begin() + firstchecksum +
+                  static_cast<std::ptrdiff_t>(o.prefixlengths.size()),
+                modes.end());
+  }
 
-    // read bytes (destroys the sorting, for disk reading efficiency)
-    gswd.fillwithbytes(it[0].first, it[-1].first, o.nsecsleep);
+  // blocks spread over the files go before all checksums, they are quick to
+  // read and tell apart files which only differ in the middle
+  if (o.sampleblocks > 0) {
+    modes.insert(modes.begin() + firstchecksum,
+                 Stage{ Fileinfo::readtobuffermode::READ_SAMPLED_BLOCKS,
+                        Fileinfo::filesizetype{ o.sampleblocks } *
+                          Fileinfo::SampledBlockSize,
+                        std::to_string(o.sampleblocks) + " sampled blocks" });
+  }
 
-    // remove non-duplicates
-    std::cout << "removed " << gswd.removeUniqSizeAndBuffer()
+  // each group of equal size goes through all stages on its own
+  std::vector<Rdutil::Stage> stages;
+  for (auto it = modes.begin() + 1; it != modes.end(); ++it) {
+    stages.push_back(Rdutil::Stage{ it->mode, it->length });
+  }
+  std::size_t nleft = filelist.size();
+  const auto removed =
+    gswd.eliminatebysize(stages, o.nsecsleep, o.readthreads);
+  for (std::size_t i = 0; i < removed.size(); ++i) {
+    nleft -= removed[i];
+    std::cout << dryruntext << "Now eliminating candidates based on "
+              << modes[i + 1].description << ": removed " << removed[i]
+              << " files from list. " << nleft << " files left." << std::endl;
+  }
+  if (o.lockstep) {
+    std::cout << dryruntext
+              << "Now eliminating candidates based on comparing contents: "
+              << std::flush;
+    std::cout << "removed "
+              << gswd.removeUniqContent(o.nsecsleep, o.readthreads)
               << " files from list. ";
     std::cout << filelist.size() << " files left." << std::endl;
   }
 
-  // What is left now is a list of duplicates, ordered on size.
-  // We also know the list is ordered on size, then bytes, and all unique
-  // files are gone so it contains sequences of duplicates. Go ahead and mark
-  // them.
+  // What is left now is a list of duplicates, all unique files are gone.
+  // Go ahead and sort them into sequences of duplicates, and mark them.
   gswd.markduplicates();
 
   std::cout << dryruntext << "It seems like you have " << filelist.size()
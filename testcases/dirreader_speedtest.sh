@@ -0,0 +1,29 @@
+#!/bin/sh
+# Performance test for reading large flat directories, comparing
+# readdir against getdents. Not meant to be run for regular testing.
+
+
+set -e
+. "$(dirname "$0")/common_funcs.sh"
+
+reset_teststate
+
+for n in 100000 1000000 ; do
+   mkdir -p speedtest/flat$n
+   seq $n | sed 's/^/entry/' | (cd speedtest/flat$n && xargs touch)
+done
+
+for n in 100000 1000000 ; do
+   #warm up the cache
+   $rdfind -makeresultsfile false speedtest/flat$n >rdfind.out
+   for dirreader in readdir getdents; do
+      dbgecho "reading $n entries with $dirreader"
+      time $rdfind -makeresultsfile false -dirreader $dirreader speedtest/flat$n >rdfind.out
+   done
+   for dirbuffer in 32768 262144 4194304; do
+      dbgecho "reading $n entries with getdents and a $dirbuffer byte buffer"
+      time $rdfind -makeresultsfile false -dirreader getdents -dirbuffer $dirbuffer speedtest/flat$n >rdfind.out
+   done
+done
+
+dbgecho "all is good in this test!"
@@ -0,0 +1,33 @@
+#!/bin/sh
+# Performance test for statting many files, comparing the synchronous
+# stat engine against io_uring. Runs on tmpfs (/dev/shm) if available,
+# unless TMPDIR is set. Not meant to be run for regular testing.
+
+
+set -e
+if [ -z "$TMPDIR" ] && [ -d /dev/shm ] ; then
+   TMPDIR=/dev/shm
+   export TMPDIR
+fi
+. "$(dirname "$0")/common_funcs.sh"
+
+reset_teststate
+
+for n in 10000 100000 ; do
+   mkdir -p speedtest/tree$n
+   for i in $(seq 0 9) ; do
+      mkdir -p speedtest/tree$n/d$i
+      seq $((n / 10)) | sed 's/^/entry/' | (cd speedtest/tree$n/d$i && xargs touch)
+   done
+done
+
+for n in 10000 100000 ; do
+   #warm up the cache
+   $rdfind -makeresultsfile false -minsize 0 speedtest/tree$n >rdfind.out
+   for statengine in sync uring; do
+      dbgecho "statting $n files with $statengine"
+      time $rdfind -makeresultsfile false -minsize 0 -statengine $statengine speedtest/tree$n >rdfind.out
+   done
+done
+
+dbgecho "all is good in this test!"
@@ -0,0 +1,47 @@
+#!/bin/sh
+# Ensures that the directory readers give the same result.
+#
+
+
+set -e
+. "$(dirname "$0")/common_funcs.sh"
+
+#make a tree with duplicates, with more entries than fit in a small buffer
+makefiles() {
+   for i in $(seq 0 4) ; do
+      mkdir -p d$i/sub
+      for j in $(seq 0 99) ; do
+         echo "content $j" >d$i/a_rather_long_file_name_to_fill_the_buffer$j
+      done
+      echo "content $i" >d$i/sub/b
+   done
+}
+
+reset_teststate
+makefiles
+
+$rdfind -dirreader readdir -dirbuffer 4096 -outputname results1.txt d* >rdfind.out
+
+if ! $rdfind -dirreader getdents d0 >rdfind.out 2>&1 ; then
+   dbgecho "getdents is not supported on this system, skipping the rest"
+   exit 0
+fi
+
+for dirbuffer in 4096 1048576 ; do
+   $rdfind -dirreader getdents -dirbuffer $dirbuffer -outputname results2.txt d* >rdfind.out
+   verify cmp results1.txt results2.txt
+   dbgecho "passed -dirbuffer $dirbuffer test case"
+done
+
+#bad values should be reported as misusage
+if $rdfind -dirreader nosuchreader d* >rdfind.out 2>&1; then
+   dbgecho "bad -dirreader should have been rejected"
+   exit 1
+fi
+if $rdfind -dirbuffer 10 d* >rdfind.out 2>&1; then
+   dbgecho "too small -dirbuffer should have been rejected"
+   exit 1
+fi
+dbgecho "passed bad value test case"
+
+dbgecho "all is good for the dirreader test!"
@@ -0,0 +1,65 @@
+#!/bin/sh
+# Ensures that -exclude and -excludedir skip what they should, and nothing
+# else.
+#
+
+
+set -e
+. "$(dirname "$0")/common_funcs.sh"
+
+#make a tree where each kind of excluded item has a duplicate outside
+makefiles() {
+   mkdir -p tree/src tree/node_modules/pkg tree/.git/objects tree/build/tmp
+   echo "module" >tree/src/module.js
+   echo "module" >tree/node_modules/pkg/module.js
+   echo "object" >tree/src/main.c
+   echo "object" >tree/.git/objects/ab
+   echo "binary" >tree/src/keep.bin
+   echo "binary" >tree/src/main.o
+   echo "temp" >tree/src/notes.txt
+   echo "temp" >tree/build/tmp/notes.txt
+}
+
+reset_teststate
+makefiles
+
+$rdfind tree >rdfind.out
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 8 ]
+dbgecho "passed no exclude test case"
+
+$rdfind -excludedir node_modules -excludedir .git tree >rdfind.out
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 4 ]
+verify [ "$(grep -c node_modules results.txt)" -eq 0 ]
+verify [ "$(grep -c objects results.txt)" -eq 0 ]
+dbgecho "passed -excludedir test case"
+
+$rdfind -exclude "*.o" tree >rdfind.out
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 6 ]
+verify [ "$(grep -c main.o results.txt)" -eq 0 ]
+$rdfind -exclude "main.?" tree >rdfind.out
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 4 ]
+dbgecho "passed -exclude test case"
+
+#patterns with a slash are matched against the path
+$rdfind -excludedir "*/build/*" tree >rdfind.out
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 6 ]
+verify [ "$(grep -c build results.txt)" -eq 0 ]
+dbgecho "passed path pattern test case"
+
+#a directory pattern does not exclude files, and the other way around
+$rdfind -exclude node_modules -excludedir "*.o" tree >rdfind.out
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 8 ]
+dbgecho "passed file/directory separation test case"
+
+#starting points are not excluded
+$rdfind -excludedir tree tree >rdfind.out
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 8 ]
+dbgecho "passed starting point test case"
+
+#the stat engine must not matter
+if $rdfind -statengine uring -excludedir node_modules -excludedir .git -exclude "*.o" tree >rdfind.out 2>&1; then
+   verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 2 ]
+fi
+dbgecho "passed statengine test case"
+
+dbgecho "all is good for the exclude test!"
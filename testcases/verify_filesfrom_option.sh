@@ -0,0 +1,89 @@
+#!/bin/sh
+# Ensures that -files-from finds the same duplicates as traversing, with
+# and without columns.
+#
+
+
+set -e
+. "$(dirname "$0")/common_funcs.sh"
+
+makefiles() {
+   mkdir -p a/b "c d"
+   echo "first" >a/1
+   echo "first" >a/b/1
+   echo "first" >"c d/with space"
+   echo "second" >a/2
+   echo "second" >"c d/2"
+   echo "unique" >a/3
+   ln -s 1 a/link
+}
+
+reset_teststate
+makefiles
+
+$rdfind a "c d" >rdfind.out
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 5 ]
+dbgecho "passed traversal reference case"
+
+find a "c d" -print0 >list
+$rdfind -files-from list >rdfind.out
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 5 ]
+verify grep -q space$ results.txt
+dbgecho "passed -files-from test case"
+
+find a "c d" -print0 | $rdfind -files-from - >rdfind.out
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 5 ]
+dbgecho "passed -files-from stdin test case"
+
+#absolute paths must be kept as given
+find "$datadir/a" -print0 | $rdfind -files-from - >rdfind.out
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 2 ]
+verify grep -q "$datadir/a/b/1$" results.txt
+dbgecho "passed absolute path test case"
+
+#with columns, nothing is statted so the files may even be gone
+find a "c d" -type f -printf '%s %D %i %p\0' >columnlist
+$rdfind -files-from columnlist -files-from-columns true -outputname results2.txt >rdfind.out
+verify [ "$(grep -c "^DUPTYPE" results2.txt)" -eq 5 ]
+mv a e
+$rdfind -files-from columnlist -files-from-columns true -outputname results3.txt >rdfind.out 2>&1 || true
+verify grep -q total rdfind.out
+mv e a
+dbgecho "passed -files-from-columns test case"
+
+#a stale size in the list must not make a changed file a duplicate
+reset_teststate
+mkdir d
+echo "hello12345" >d/a
+echo "hello12345" >d/b
+find d -type f -printf '%s %D %i %p\0' >columnlist
+printf 'IMPORTANT-UNIQUE-DATA' >>d/b
+$rdfind -files-from columnlist -files-from-columns true -deleteduplicates true >rdfind.out 2>&1
+verify [ -f d/a ]
+verify [ -f d/b ]
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 0 ]
+dbgecho "passed stale size test case"
+
+#the last record may lack its terminator, and must not pick up what is
+#left of a longer record before it
+cp d/a d/bb
+printf 'd/a\0d/bb' >list
+$rdfind -files-from list >rdfind.out 2>&1
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 2 ]
+verify grep -q "d/bb$" results.txt
+dbgecho "passed unterminated last record test case"
+
+#malformed records are reported and skipped
+printf 'x y z a/1\0' >badlist
+$rdfind -files-from badlist -files-from-columns true >rdfind.out 2>&1
+verify grep -q malformed rdfind.out
+dbgecho "passed malformed record test case"
+
+#a missing list is an error
+if $rdfind -files-from nosuchlist >rdfind.out 2>&1; then
+   dbgecho "a missing file list should have been rejected"
+   exit 1
+fi
+dbgecho "passed missing list test case"
+
+dbgecho "all is good for the files-from test!"
@@ -0,0 +1,60 @@
+#!/bin/sh
+# Ensures that -lockstep compares the contents of the candidates, and finds
+# the same duplicates as the checksums. the sets of duplicates may come in
+# another order.
+#
+
+
+set -e
+. "$(dirname "$0")/common_funcs.sh"
+
+# makes file $1 of 3000000 bytes, with byte $2 changed unless it is 0
+makefile() {
+   head -c 3000000 /dev/zero | tr '\0' 'a' >"$1"
+   if [ "$2" -ne 0 ]; then
+      printf b | dd of="$1" bs=1 seek="$2" conv=notrunc 2>/dev/null
+   fi
+}
+
+reset_teststate
+mkdir a
+makefile a/same1 0
+makefile a/same2 0
+makefile a/same3 0
+makefile a/early 1000
+makefile a/late 2500000
+makefile a/late2 2500000
+echo "short" >a/short1
+echo "short" >a/short2
+
+$rdfind -checksum sha1 a >rdfind1.out
+sort results.txt >results1.txt
+$rdfind -lockstep true a >rdfind2.out
+sort results.txt >results2.txt
+verify cmp results1.txt results2.txt
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 7 ]
+verify grep -q "^Now.eliminating.candidates.based.on.comparing.contents:.removed.1.files" rdfind2.out
+if grep -q "checksum" rdfind2.out; then
+   dbgecho "-lockstep should not make checksums of whole files"
+   exit 1
+fi
+dbgecho "passed the comparison test case"
+
+#the files are still compared after checksums of their start
+$rdfind -prefixchecksums 4K -checksum sha1 a >rdfind.out
+sort results.txt >results1.txt
+$rdfind -prefixchecksums 4K -lockstep true a >rdfind.out
+sort results.txt >results2.txt
+verify cmp results1.txt results2.txt
+verify grep -q "first.4096.bytes:.removed.1.files" rdfind.out
+verify grep -q "comparing.contents:.removed.0.files" rdfind.out
+dbgecho "passed the prefix test case"
+
+#files with colliding md5 checksums are told apart
+mkdir md5coll
+cp "$testscriptsdir"/md5collisions/*.ps md5coll
+$rdfind -checksum md5 -lockstep true -deleteduplicates true md5coll >rdfind.out
+verify grep -q "^Deleted.0.files.$" rdfind.out
+dbgecho "passed the md5 collision test case"
+
+dbgecho "all is good for the lockstep test!"
@@ -0,0 +1,66 @@
+#!/bin/sh
+# Ensures that deep trees are traversed, that -maxdepth limits the depth
+# and that the traversal order does not change the result.
+#
+
+
+set -e
+. "$(dirname "$0")/common_funcs.sh"
+
+#make a tree deeper than the old recursion limit of 50, with a duplicate
+#of a file near the top at the bottom
+makefiles() {
+   dir=deep
+   for i in $(seq 1 120) ; do
+      dir=$dir/d
+   done
+   mkdir -p $dir
+   echo "deep content" >deep/a
+   echo "deep content" >$dir/b
+   mkdir -p wide/x/y wide/z
+   echo "wide content" >wide/a
+   echo "wide content" >wide/x/y/b
+   echo "wide content" >wide/z/c
+}
+
+reset_teststate
+makefiles
+
+$rdfind deep >rdfind.out
+verify grep -q "^DUPTYPE_WITHIN_SAME_TREE.*/d/b$" results.txt
+dbgecho "passed deep tree test case"
+
+$rdfind -maxdepth 119 deep >rdfind.out 2>&1
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 0 ]
+verify grep -q recursion rdfind.out
+$rdfind -maxdepth 120 deep >rdfind.out 2>&1
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 2 ]
+dbgecho "passed -maxdepth 119/120 test case"
+
+$rdfind -maxdepth 0 wide >rdfind.out 2>&1
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 0 ]
+$rdfind -maxdepth 1 wide >rdfind.out 2>&1
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 2 ]
+$rdfind -maxdepth -1 wide >rdfind.out 2>&1
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 3 ]
+dbgecho "passed -maxdepth 0/1/-1 test case"
+
+$rdfind -order depthfirst -threads 1 -outputname results1.txt deep wide >rdfind.out
+$rdfind -order breadthfirst -threads 1 -outputname results2.txt deep wide >rdfind.out
+verify cmp results1.txt results2.txt
+$rdfind -order breadthfirst -threads 4 -outputname results2.txt deep wide >rdfind.out
+verify cmp results1.txt results2.txt
+dbgecho "passed -order test case"
+
+#bad values should be reported as misusage
+if $rdfind -order nosuchorder wide >rdfind.out 2>&1; then
+   dbgecho "bad -order should have been rejected"
+   exit 1
+fi
+if $rdfind -maxdepth -2 wide >rdfind.out 2>&1; then
+   dbgecho "bad -maxdepth should have been rejected"
+   exit 1
+fi
+dbgecho "passed bad value test case"
+
+dbgecho "all is good for the maxdepth test!"
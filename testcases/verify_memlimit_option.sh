@@ -0,0 +1,52 @@
+#!/bin/sh
+# Ensures that -memlimit gives the same result as keeping everything in
+# memory, also when the sorts have to be done in many runs.
+#
+
+
+set -e
+. "$(dirname "$0")/common_funcs.sh"
+
+#many files with few sizes, so the list is sorted in many runs
+makefiles() {
+   for d in 1 2 3 4 5 6 7 8; do
+      mkdir -p tree/$d
+      for f in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16; do
+         echo "content $((f % 5))" >tree/$d/$f
+         echo "other $d" >tree/$d/other$f
+      done
+   done
+}
+
+reset_teststate
+makefiles
+
+$rdfind -memlimit 1G -outputname results1.txt tree >rdfind.out
+verify [ "$(grep -c "^DUPTYPE" results1.txt)" -eq 256 ]
+$rdfind -memlimit 1K -outputname results2.txt tree >rdfind.out
+verify cmp results1.txt results2.txt
+mkdir tmp
+TMPDIR=$datadir/tmp $rdfind -memlimit 64 -outputname results2.txt tree >rdfind.out
+verify cmp results1.txt results2.txt
+dbgecho "passed memlimit test case"
+
+#the temporary files are removed
+verify [ -z "$(ls tmp)" ]
+dbgecho "passed cleanup test case"
+
+#bad values should be reported as misusage
+if $rdfind -memlimit 0 tree >rdfind.out 2>&1; then
+   dbgecho "-memlimit 0 should have been rejected"
+   exit 1
+fi
+if $rdfind -memlimit 12X tree >rdfind.out 2>&1; then
+   dbgecho "-memlimit 12X should have been rejected"
+   exit 1
+fi
+if $rdfind -memlimit -1 tree >rdfind.out 2>&1; then
+   dbgecho "-memlimit -1 should have been rejected"
+   exit 1
+fi
+dbgecho "passed bad value test case"
+
+dbgecho "all is good for the memlimit test!"
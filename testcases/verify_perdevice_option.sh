@@ -0,0 +1,47 @@
+#!/bin/sh
+# Ensures that scanning and reading devices concurrently gives the same
+# result as doing it one device at a time.
+#
+
+
+set -e
+. "$(dirname "$0")/common_funcs.sh"
+
+reset_teststate
+
+#put a second tree on another device, if there is a tmpfs to use
+otherdir=
+if [ -d /dev/shm ] && [ -w /dev/shm ] ; then
+   otherdir=$(mktemp -d /dev/shm/rdfindtestcases.d.XXXXXXXXXXXX)
+   trap 'cleanup; rm -rf "$otherdir"' INT QUIT EXIT
+fi
+
+#make trees with duplicates within and across the trees
+makefiles() {
+   for dir in a b ${otherdir:+"$otherdir/c"} ; do
+      mkdir -p "$dir/sub"
+      for j in $(seq 0 49) ; do
+         echo "content $j" >"$dir/file$j"
+         head -c 1000 /dev/zero | tr '\0' "$((j % 10))" >"$dir/sub/zeros$j"
+      done
+   done
+}
+
+makefiles
+
+#all runs get the same number of arguments, since that is the priority
+$rdfind -perdevice false -readthreads 1 -outputname results1.txt a ${otherdir:+"$otherdir/c"} b >rdfind.out
+for readthreads in 1 4 ; do
+   $rdfind -perdevice true -readthreads $readthreads -outputname results2.txt a ${otherdir:+"$otherdir/c"} b >rdfind.out
+   verify cmp results1.txt results2.txt
+   dbgecho "passed -readthreads $readthreads test case"
+done
+
+#bad values should be reported as misusage
+if $rdfind -readthreads 0 a >rdfind.out 2>&1; then
+   dbgecho "bad -readthreads should have been rejected"
+   exit 1
+fi
+dbgecho "passed bad value test case"
+
+dbgecho "all is good for the perdevice test!"
@@ -0,0 +1,52 @@
+#!/bin/sh
+# Ensures that -prefixchecksums eliminates files differing early, and gives
+# the same result as without it.
+#
+
+
+set -e
+. "$(dirname "$0")/common_funcs.sh"
+
+# makes file $1 of 200000 bytes, with byte $2 changed unless it is 0
+makefile() {
+   head -c 200000 /dev/zero | tr '\0' 'a' >"$1"
+   if [ "$2" -ne 0 ]; then
+      printf b | dd of="$1" bs=1 seek="$2" conv=notrunc 2>/dev/null
+   fi
+}
+
+reset_teststate
+mkdir a
+makefile a/same1 0
+makefile a/same2 0
+makefile a/early 1000
+makefile a/late 150000
+echo "short" >a/short1
+echo "short" >a/short2
+
+$rdfind -checksum sha1 a >rdfind1.out
+cp results.txt results1.txt
+$rdfind -prefixchecksums 4K,64K a >rdfind2.out
+verify cmp results1.txt results.txt
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 4 ]
+verify grep -q "^Now.eliminating.candidates.based.on.sha1.checksum.of.the.first.4096.bytes:.removed.1.files" rdfind2.out
+verify grep -q "^Now.eliminating.candidates.based.on.sha1.checksum.of.the.first.65536.bytes:.removed.0.files" rdfind2.out
+verify grep -q "^Now.eliminating.candidates.based.on.sha1.checksum:.removed.1.files" rdfind2.out
+dbgecho "passed the elimination test case"
+
+#a start longer than the files
+$rdfind -prefixchecksums 1M a >rdfind.out
+verify cmp results1.txt results.txt
+verify grep -q "first.1048576.bytes:.removed.2.files" rdfind.out
+dbgecho "passed the long start test case"
+
+#bad lists are rejected
+for list in 0 4K, ,4K 4X; do
+   if $rdfind -prefixchecksums "$list" a >rdfind.out 2>&1; then
+      dbgecho "-prefixchecksums $list should have been rejected"
+      exit 1
+   fi
+done
+dbgecho "passed the bad list test case"
+
+dbgecho "all is good for the prefixchecksums test!"
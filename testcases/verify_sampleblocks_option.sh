@@ -0,0 +1,54 @@
+#!/bin/sh
+# Ensures that -sampleblocks eliminates files differing in the middle, and
+# gives the same result as without it.
+#
+
+
+set -e
+. "$(dirname "$0")/common_funcs.sh"
+
+# makes file $1 of 1000000 bytes, with bytes 1000 to 999000 changed to $2
+# unless it is empty
+makefile() {
+   head -c 1000000 /dev/zero | tr '\0' 'a' >"$1"
+   if [ -n "$2" ]; then
+      head -c 998000 /dev/zero | tr '\0' "$2" |
+         dd of="$1" bs=1000 seek=1 conv=notrunc 2>/dev/null
+   fi
+}
+
+reset_teststate
+mkdir a
+makefile a/same1 ""
+makefile a/same2 ""
+makefile a/middle1 b
+makefile a/middle2 c
+makefile a/middle3 c
+echo "short" >a/short1
+echo "short" >a/short2
+
+$rdfind -checksum sha1 a >rdfind1.out
+cp results.txt results1.txt
+$rdfind -sampleblocks 4 a >rdfind2.out
+verify cmp results1.txt results.txt
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 6 ]
+verify grep -q "^Now.eliminating.candidates.based.on.4.sampled.blocks:.removed.1.files" rdfind2.out
+verify grep -q "^Now.eliminating.candidates.based.on.sha1.checksum:.removed.0.files" rdfind2.out
+dbgecho "passed the elimination test case"
+
+#more blocks than fit in the files
+$rdfind -sampleblocks 1000 a >rdfind.out
+verify cmp results1.txt results.txt
+verify grep -q "1000.sampled.blocks:.removed.1.files" rdfind.out
+dbgecho "passed the many blocks test case"
+
+#bad numbers are rejected
+for n in -1 65537; do
+   if $rdfind -sampleblocks "$n" a >rdfind.out 2>&1; then
+      dbgecho "-sampleblocks $n should have been rejected"
+      exit 1
+   fi
+done
+dbgecho "passed the bad number test case"
+
+dbgecho "all is good for the sampleblocks test!"
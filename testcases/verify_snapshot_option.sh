@@ -0,0 +1,82 @@
+#!/bin/sh
+# Ensures that -snapshot reuses unchanged directories, notices changed ones
+# and gives the same result as reading everything.
+#
+
+
+set -e
+. "$(dirname "$0")/common_funcs.sh"
+
+makefiles() {
+   mkdir -p tree/a/b tree/c
+   echo "first" >tree/a/1
+   echo "first" >tree/a/b/1
+   echo "second" >tree/c/2
+   echo "unique" >tree/a/b/3
+   ln -s ../c tree/a/linkdir
+}
+
+reset_teststate
+makefiles
+#directories changed within the last second are not kept in the snapshot
+sleep 2
+
+$rdfind -snapshot snap tree >rdfind.out
+verify grep -q "^Reused.0.of.4" rdfind.out
+verify [ -f snap ]
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 2 ]
+cp results.txt results1.txt
+dbgecho "passed first run test case"
+
+$rdfind -snapshot snap tree >rdfind.out
+verify grep -q "^Reused.4.of.4" rdfind.out
+verify cmp results.txt results1.txt
+dbgecho "passed unchanged test case"
+
+#the same with the followed symlink, which is not in the snapshot
+$rdfind -snapshot snap -followsymlinks true -removeidentinode false tree >rdfind.out
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 4 ]
+dbgecho "passed followsymlinks test case"
+
+#a new file changes its directory, which must then be read
+echo "second" >tree/a/b/2
+$rdfind -snapshot snap tree >rdfind.out
+verify grep -q "^Reused.3.of.4" rdfind.out
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 4 ]
+dbgecho "passed changed directory test case"
+
+#a broken snapshot is reported, and everything is read
+echo "garbage" >snap
+$rdfind -snapshot snap tree >rdfind.out 2>&1
+verify grep -q "could.not.read.snapshot" rdfind.out
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 4 ]
+dbgecho "passed broken snapshot test case"
+
+#a file written to in place does not change its directory, the snapshot
+#must not make it look like the duplicate it was before
+reset_teststate
+mkdir d
+echo "hello12345" >d/a
+echo "hello12345" >d/b
+sleep 2
+$rdfind -snapshot snap d >rdfind.out
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 2 ]
+printf 'IMPORTANT-UNIQUE-DATA' >>d/b
+$rdfind -snapshot snap -deleteduplicates true d >rdfind.out
+verify grep -q "^Reused.1.of.1" rdfind.out
+verify [ -f d/a ]
+verify [ -f d/b ]
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 0 ]
+dbgecho "passed grown file test case"
+
+#a truncated snapshot is rejected as a whole
+for cut in 3 60; do
+   $rdfind -snapshot snap d >rdfind.out
+   head -c $(($(wc -c <snap) - cut)) snap >snap.cut
+   mv snap.cut snap
+   $rdfind -snapshot snap d >rdfind.out 2>&1
+   verify grep -q "could.not.read.snapshot" rdfind.out
+done
+dbgecho "passed truncated snapshot test case"
+
+dbgecho "all is good for the snapshot test!"
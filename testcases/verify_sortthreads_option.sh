@@ -0,0 +1,37 @@
+#!/bin/sh
+# Ensures that -sortthreads gives the same result as one thread.
+#
+
+
+set -e
+. "$(dirname "$0")/common_funcs.sh"
+
+reset_teststate
+
+#a list large enough to be sorted and grouped in parallel, of small files
+#with few sizes. all but every 1000th file have the same content as others,
+#and every 10th file is listed twice, so it has the same inode as another.
+mkdir files
+seq 0 139999 |
+   awk '{ if ($1 % 1000 == 7) print "unique " $1; else print "content " $1 % 5000 }' >lines
+(cd files && split -l 1 -a 5 ../lines f)
+find files -type f | sort | awk '{ print; if (NR % 10 == 0) print }' |
+   tr '\n' '\0' >list
+
+$rdfind -sortthreads 1 -files-from list -outputname results1.txt >rdfind1.out
+$rdfind -sortthreads 4 -files-from list -outputname results4.txt >rdfind4.out
+verify [ "$(grep -c "^DUPTYPE" results1.txt)" -eq 139860 ]
+verify cmp results1.txt results4.txt
+verify grep -q "^Removed.14000.files.due.to.nonunique" rdfind4.out
+dbgecho "passed the large list test case"
+
+#a small tree, sorted by one thread regardless
+mkdir -p a/b
+echo "same" >a/1
+echo "same" >a/b/1
+echo "sam2" >a/2
+$rdfind -sortthreads 8 a >rdfind.out
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 2 ]
+dbgecho "passed the small tree test case"
+
+dbgecho "all is good for the sortthreads test!"
@@ -0,0 +1,47 @@
+#!/bin/sh
+# Ensures that the stat engines give the same result.
+#
+
+
+set -e
+. "$(dirname "$0")/common_funcs.sh"
+
+#make a tree with duplicates, with more entries than are statted at once
+makefiles() {
+   for i in $(seq 0 2) ; do
+      mkdir -p d$i/sub
+      for j in $(seq 0 299) ; do
+         echo "content $j" >d$i/file$j
+      done
+      echo "content $i" >d$i/sub/b
+      ln -s file0 d$i/link
+      ln -s sub d$i/linkdir
+   done
+}
+
+reset_teststate
+makefiles
+
+for follow in false true ; do
+   $rdfind -followsymlinks $follow -statengine sync -outputname results1.txt d* >rdfind.out
+   $rdfind -followsymlinks $follow -statengine uring -outputname results2.txt d* >rdfind.out 2>&1
+   verify cmp results1.txt results2.txt
+   dbgecho "passed -followsymlinks $follow test case"
+done
+
+#combined with the other traversal options
+if $rdfind -dirreader getdents d0 >rdfind.out 2>&1 ; then
+   $rdfind -threads 1 -dirreader readdir -statengine sync -outputname results1.txt d* >rdfind.out
+   $rdfind -threads 4 -dirreader getdents -statengine uring -outputname results2.txt d* >rdfind.out 2>&1
+   verify cmp results1.txt results2.txt
+   dbgecho "passed combined options test case"
+fi
+
+#bad values should be reported as misusage
+if $rdfind -statengine nosuchengine d* >rdfind.out 2>&1; then
+   dbgecho "bad -statengine should have been rejected"
+   exit 1
+fi
+dbgecho "passed bad value test case"
+
+dbgecho "all is good for the statengine test!"
@@ -0,0 +1,41 @@
+#!/bin/sh
+# Ensures that traversing with several threads gives the same
+# result as the single threaded traversal.
+#
+
+
+set -e
+. "$(dirname "$0")/common_funcs.sh"
+
+#make a tree with duplicates spread over many directories
+makefiles() {
+   for i in $(seq 0 9) ; do
+      for j in $(seq 0 4) ; do
+         mkdir -p d$i/e$j/f
+         echo "content $j" >d$i/e$j/a
+         echo "content $i" >d$i/e$j/f/b
+         echo "unique $i $j" >d$i/e$j/f/c
+      done
+   done
+}
+
+reset_teststate
+makefiles
+
+$rdfind -threads 1 -outputname results1.txt d* >rdfind.out
+for n in 2 3 8 ; do
+   $rdfind -threads $n -outputname results$n.txt d* >rdfind.out
+   verify cmp results1.txt results$n.txt
+   dbgecho "passed -threads $n test case"
+done
+
+#bad thread counts should be reported as misusage
+for n in 0 -1 ; do
+   if $rdfind -threads $n d* >rdfind.out 2>&1; then
+      dbgecho "-threads $n should have been rejected"
+      exit 1
+   fi
+done
+dbgecho "passed bad value test case"
+
+dbgecho "all is good for the threads test!"
@@ -0,0 +1,47 @@
+#!/bin/sh
+# Ensures that -twopass gives the same result as a single pass.
+#
+
+
+set -e
+. "$(dirname "$0")/common_funcs.sh"
+
+makefiles() {
+   mkdir -p a/b c
+   echo "same" >a/1
+   echo "same" >a/b/1
+   echo "same" >c/1
+   echo "sam2" >c/2
+   echo "unique size" >a/3
+   echo "another unique size" >c/4
+   echo "x" >a/b/5
+}
+
+reset_teststate
+makefiles
+
+$rdfind -twopass false a c >rdfind1.out
+cp results.txt results1.txt
+$rdfind -twopass true a c >rdfind2.out
+verify cmp results1.txt results.txt
+verify [ "$(grep -c "^DUPTYPE" results.txt)" -eq 3 ]
+verify grep -q "^Counted.7.files" rdfind2.out
+#the statistics are the same
+grep -v ^Counted rdfind2.out >rdfind3.out
+verify cmp rdfind1.out rdfind3.out
+dbgecho "passed -twopass test case"
+
+find a c -print0 >list
+$rdfind -twopass false -files-from list -outputname results1.txt >rdfind.out
+$rdfind -twopass true -files-from list -outputname results2.txt >rdfind.out
+verify cmp results1.txt results2.txt
+dbgecho "passed -twopass with -files-from test case"
+
+#a file list on stdin can not be read twice
+if find a c -print0 | $rdfind -twopass true -files-from - >rdfind.out 2>&1; then
+   dbgecho "-twopass with stdin should have been rejected"
+   exit 1
+fi
+dbgecho "passed stdin test case"
+
+dbgecho "all is good for the twopass test!"